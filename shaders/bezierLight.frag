@@ -2,7 +2,6 @@
 
 #define PI 3.141592653589793
 #define INV_PI 0.3183098861837907
-#define MAX_N_POINTS 48
 #define NUM_CPS_IN_CURVE 4
 
 in vec3 f_vertPosWorld;
@@ -11,9 +10,7 @@ in vec2 f_texcoord;
 out vec4 out_color;
 
 uniform vec3 u_lightLe;
-uniform vec3 u_cpsWorld[MAX_N_POINTS];
 
-uniform int u_numCurves;
 uniform int u_texWidth;
 uniform int u_texHeight;
 uniform int u_marginSize;
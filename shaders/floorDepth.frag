@@ -0,0 +1,6 @@
+#version 410
+
+// depth pre-pass of the floor, no color output
+
+void main(void) {
+}
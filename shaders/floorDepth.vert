@@ -0,0 +1,12 @@
+#version 410
+
+layout(location = 0) in vec3 in_position;
+
+uniform mat4 u_mvpMat;
+
+// must match floorLTC.vert bit for bit, the LTC pass tests depth with GL_EQUAL
+invariant gl_Position;
+
+void main(){
+    gl_Position = u_mvpMat * vec4(in_position, 1.0);
+}
@@ -0,0 +1,48 @@
+#version 410
+
+// ----------------------------------------------
+// G-buffer pass of the floor (see gBuffer.h)
+// Lighting is evaluated by floorLTC.frag compiled with DEFERRED.
+// ----------------------------------------------
+
+#ifndef ROUGH_TEXTURED
+#define ROUGH_TEXTURED u_isRoughTexed
+#endif
+
+in vec3 f_normalWorld;
+in vec3 f_vertPosWorld;
+in vec2 f_texcoord;
+
+layout(location = 0) out vec4 out_position;
+layout(location = 1) out vec4 out_normal;
+layout(location = 2) out vec4 out_diffuse;
+layout(location = 3) out vec4 out_specular;
+
+uniform float u_alpha;
+uniform vec3 u_diffColor;
+uniform vec3 u_specColor;
+
+uniform bool u_isRoughTexed;
+uniform sampler2D u_roughnessTex;
+
+#ifdef LIGHTMAP
+uniform sampler2D u_lightmap;  // baked diffuse radiance without albedo
+
+const float gamma = 2.2;
+vec3 toLinear(in vec3 v) { return pow(clamp(v, vec3(0.0), vec3(1.0)), vec3(gamma)); }
+#endif
+
+void main(void) {
+    float alpha = u_alpha;
+    if (ROUGH_TEXTURED) { alpha = texture(u_roughnessTex, f_texcoord).x; }
+
+    out_position = vec4(f_vertPosWorld, gl_FragCoord.z);
+    out_normal = vec4(normalize(f_normalWorld), alpha);
+#ifdef LIGHTMAP
+    // the lighting pass takes the baked diffuse term as it is
+    out_diffuse = vec4(toLinear(u_diffColor) * texture(u_lightmap, f_texcoord).rgb, 1.0);
+#else
+    out_diffuse = vec4(u_diffColor, 1.0);
+#endif
+    out_specular = vec4(u_specColor, 1.0);
+}
@@ -6,48 +6,124 @@
 #define INV_TWO_PI 0.15915494309189535
 #define EPS 1.0e-5
 
-#define MAX_N_POINTS 48
 #define NUM_CPS_IN_CURVE 4 // 3rd-order Bezier curve
-#define MAX_N_CURVES (MAX_N_POINTS / NUM_CPS_IN_CURVE)
 #define NUM_INTERSECTION_MAX 3 // 3rd-order Bezier curve
 
+// must match bezierLightSet.h
+#define CURVE_RECORD_SIZE 8
+#define MAX_LIGHT_LODS 4
+#define LIGHT_RECORD_SIZE (10 + MAX_LIGHT_LODS)
+#define MAX_LIGHT_TEXTURES 4
+#define LIGHT_TWO_SIDED 1
+#define LIGHT_TEXTURED 2
+
+// must match lightCulling.h
+#define LIGHT_TILE_SIZE 16
+#define TILE_LIGHT_SPECULAR 0x80000000u
+
+// ----------------------------------------------
+// permutation defines (see LtcSurface::useShaderVariant)
+// Each feature falls back to its runtime uniform when not specialized.
+// ----------------------------------------------
+#define CLIP_ALGEBRAIC 0
+#define CLIP_BEZIER 1
+#define CLIP_POLYGON 2
+#define CLIP_NEWTON 3
+
+// per-pixel cost shown by the heatmap (COST_METRIC), see ltcSurface.h
+#define COST_EDGES 1
+#define COST_CURVES 2
+#define COST_CROSSINGS 3
+#define COST_ROOTS 4
+
+// false when no light in the list is textured
+#ifndef BEZ_TEXTURED
+#define BEZ_TEXTURED true
+#endif
+
+#ifndef ROUGH_TEXTURED
+#define ROUGH_TEXTURED u_isRoughTexed
+#endif
+
+#ifndef CLIP_METHOD
+#define CLIP_METHOD CLIP_ALGEBRAIC
+#endif
+
 in vec3 f_normalWorld;
 in vec3 f_vertPosWorld;
 in vec2 f_texcoord;
 
-out vec4 out_color;
-
-uniform mat4 u_bezLightMmat;
+layout(location = 0) out vec4 out_color;
+#ifdef LOWRES_PASS
+layout(location = 1) out vec4 out_lowResSpec;
+#endif
 
 uniform float u_alpha;
 uniform vec3 u_diffColor;
 uniform vec3 u_specColor;
 
 uniform vec3 u_cameraPos;
+uniform float u_pixelAngle;  // world size of a pixel per unit of distance, 0 in texture space
 
-uniform vec3 u_lightLe;
 uniform bool u_isLightMove;
-uniform vec3 u_cpsWorld[MAX_N_POINTS];
+uniform samplerBuffer u_cpsBuffer;   // CURVE_RECORD_SIZE texels per curve of all lights in world space (RGBA32F)
+uniform samplerBuffer u_lightBuffer; // LIGHT_RECORD_SIZE texels per light, then one sphere per curve (RGBA32F)
+uniform int u_numLights;
 
-uniform int u_numCurves;
-uniform int u_texWidth;
-uniform int u_texHeight;
-uniform int u_marginSize;
-uniform int u_maxLOD;
+#ifdef TILED_CULLING
+uniform usamplerBuffer u_tileHeaders; // offset and count in u_tileLights per screen tile
+uniform usamplerBuffer u_tileLights;  // light index | TILE_LIGHT_SPECULAR
+uniform int u_numTilesX;
+#endif
 
 uniform bool u_isRoughTexed;
-uniform bool u_isTwoSided;
-uniform bool u_isBezTexed;
 
 uniform sampler2D u_ltcMatTex;
 uniform sampler2D u_ltcMagTex;
-uniform sampler2D u_bezLightTex;
+uniform sampler2D u_bezLightTex[MAX_LIGHT_TEXTURES];
 uniform sampler2D u_roughnessTex;
 
+#ifdef DEFERRED
+// G-buffer written by floorGBuffer.frag (see gBuffer.h)
+uniform sampler2D u_gPosition;  // world position, window depth
+uniform sampler2D u_gNormal;    // world normal, roughness
+uniform sampler2D u_gDiffuse;
+uniform sampler2D u_gSpecular;
+#endif
+
+// ----------------------------------------------
+// reduced-resolution lighting (see LowResBuffer)
+// LOWRES_PASS evaluates diffuse (and specular of rough texels) once per
+// block of u_lowResScale^2 pixels, LOWRES_DIFFUSE upsamples it.
+// ----------------------------------------------
+#if defined(LOWRES_PASS) || defined(LOWRES_DIFFUSE)
+uniform int u_lowResScale;
+uniform float u_lowResSpecAlpha;  // specular is shaded at low resolution from this roughness
+#endif
+
+#ifdef LOWRES_DIFFUSE
+uniform sampler2D u_lowResDiff;   // diffuse radiance without albedo
+uniform sampler2D u_lowResSpec;   // specular radiance without albedo, a = 1 where evaluated
+#endif
+
+// ----------------------------------------------
+// baked diffuse (see Lightmap)
+// LIGHTMAP_BAKE renders the diffuse radiance of the floor in texture space,
+// LIGHTMAP reads it back instead of integrating diffuse every frame.
+// ----------------------------------------------
+#if defined(LIGHTMAP) && !defined(DEFERRED)
+uniform sampler2D u_lightmap;     // diffuse radiance without albedo
+#endif
+
+#ifdef POLYGON_FALLBACK
+uniform float u_polygonAlpha;     // specular integrates the flattened contour from this roughness
+#endif
+
 const float LUT_SIZE  = 64.0;
 const float LUT_SCALE = (LUT_SIZE - 1.0)/LUT_SIZE;
 const float LUT_BIAS  = 0.5/LUT_SIZE;
 
+#ifdef COST_METRIC
 // ----------------------------------------------
 // array for color mapping
 // ----------------------------------------------
@@ -117,31 +193,133 @@ const vec3 cmap_inferno[256] = vec3[256] (
     vec3( 137, 246, 243 ), vec3( 141, 247, 244 ), vec3( 145, 248, 245 ), vec3( 149, 250, 246 ),
     vec3( 153, 251, 247 ), vec3( 157, 252, 249 ), vec3( 160, 253, 250 ), vec3( 164, 254, 252 )
 );
+#endif
 
 // ----------------------------------------------
 // stack buffer for Douglas-Peucker integration
 // ----------------------------------------------
-vec2 DPstk[12];
+#define DP_STACK_SIZE 16
+vec2 DPstk[DP_STACK_SIZE];
 int DPstkIndex = 0;
 
+#ifdef COST_METRIC
+// counters of the cost view besides edgeNum
+int costCurves = 0;     // curves clipped or integrated
+int costCrossings = 0;  // curves whose control points straddle the horizon
+int costRoots = 0;      // horizon roots found
+#endif
+
 // ----------------------------------------------
 // Bezier curve
 // ----------------------------------------------
 struct Bez {
     vec3 cps[NUM_CPS_IN_CURVE];
+    vec3 coeffs[NUM_CPS_IN_CURVE];  // power basis, coeffs[i] multiplies t^i
+    int degree;                     // 1: line, 2: quadratic, 3: cubic
 };
 
-struct BezierLight {
-    Bez bezs[MAX_N_POINTS / NUM_CPS_IN_CURVE];
+// Curves are read from the buffer when they are processed, so the number of
+// curves is not limited by the shader (see BezierLightSet::upload).
+Bez fetchBez(int curve) {
+    int base = curve * CURVE_RECORD_SIZE;
+    Bez bez;
+    for (int i = 0; i < NUM_CPS_IN_CURVE; i++) {
+        bez.cps[i] = texelFetch(u_cpsBuffer, base + i).xyz;
+        bez.coeffs[i] = texelFetch(u_cpsBuffer, base + NUM_CPS_IN_CURVE + i).xyz;
+    }
+    bez.degree = int(texelFetch(u_cpsBuffer, base).w);
+    return bez;
+}
+
+// ----------------------------------------------
+// light list (see BezierLightSet::upload)
+// ----------------------------------------------
+struct Light {
+    int firstCurve;
+    int numCurves;
+    bool twoSided;
+    int texSlot;     // -1 if not textured
+    vec3 Le;
+    vec3 quadCorner; // corner (-1, -1) of the light quad
+    vec3 quadEdgeX;  // towards (1, -1)
+    vec3 quadEdgeY;  // towards (-1, 1)
+    vec4 texInfo;    // width, height, margin size, max LOD
+    vec4 plane;      // emitting side is dot(plane.xyz, P) + plane.w > 0
+    vec4 sphere;     // bounding sphere of the control points (center, radius)
+    int firstSegment;  // first texel of the pre-clipped contour
+    int numSegments;
+    int base;          // first texel of the record, for the shape levels
+    int numLevels;
+    vec4 lodErrors;    // estimated Hausdorff distance of each level to the original shape
+    int firstVertex;   // first texel of the flattened contour
+    int numVertices;
 };
 
-void initBezierLight(out BezierLight bL) {
-    for (int i = 0; i < u_numCurves; i++) {
-        bL.bezs[i].cps[0] = u_cpsWorld[i * NUM_CPS_IN_CURVE + 0];
-        bL.bezs[i].cps[1] = u_cpsWorld[i * NUM_CPS_IN_CURVE + 1];
-        bL.bezs[i].cps[2] = u_cpsWorld[i * NUM_CPS_IN_CURVE + 2];
-        bL.bezs[i].cps[3] = u_cpsWorld[i * NUM_CPS_IN_CURVE + 3];
+Light fetchLight(int index) {
+    int base = index * LIGHT_RECORD_SIZE;
+    vec4 header = texelFetch(u_lightBuffer, base + 0);
+    int flags = int(header.z);
+
+    Light light;
+    light.firstCurve = int(header.x);
+    light.numCurves = int(header.y);
+    light.twoSided = (flags & LIGHT_TWO_SIDED) != 0;
+    light.texSlot = (flags & LIGHT_TEXTURED) != 0 ? int(header.w) : -1;
+    vec4 Le = texelFetch(u_lightBuffer, base + 1);
+    light.Le = Le.rgb;
+    light.numLevels = int(Le.w);
+    light.quadCorner = texelFetch(u_lightBuffer, base + 2).xyz;
+    light.quadEdgeX = texelFetch(u_lightBuffer, base + 3).xyz;
+    light.quadEdgeY = texelFetch(u_lightBuffer, base + 4).xyz;
+    light.texInfo = texelFetch(u_lightBuffer, base + 5);
+    light.plane = texelFetch(u_lightBuffer, base + 6);
+    light.sphere = texelFetch(u_lightBuffer, base + 7);
+    vec4 level = texelFetch(u_lightBuffer, base + 8);
+    light.firstSegment = int(level.z);
+    light.numSegments = int(level.w);
+    light.base = base;
+    light.lodErrors = texelFetch(u_lightBuffer, base + 8 + MAX_LIGHT_LODS);
+    vec4 polygon = texelFetch(u_lightBuffer, base + 9 + MAX_LIGHT_LODS);
+    light.firstVertex = int(polygon.x);
+    light.numVertices = int(polygon.y);
+    return light;
+}
+
+// The light with the curves and contour of its coarsest shape level whose
+// error, seen from P, stays below the angle tol (radians)
+Light selectLightLOD(const Light light, const vec3 P, const float tol) {
+    float dist = max(length(light.sphere.xyz - P) - light.sphere.w, 1.0e-3);
+    int selected = 0;
+    for (int level = 1; level < light.numLevels; level++) {
+        if (light.lodErrors[level] <= tol * dist) {
+            selected = level;
+        }
+    }
+
+    Light lod = light;
+    vec4 range = texelFetch(u_lightBuffer, light.base + 8 + selected);
+    lod.firstCurve = int(range.x);
+    lod.numCurves = int(range.y);
+    lod.firstSegment = int(range.z);
+    lod.numSegments = int(range.w);
+    // the simplified shape stays within its error of the original one
+    lod.sphere.w += light.lodErrors[selected];
+    return lod;
+}
+
+vec4 fetchCurveSphere(int curve) {
+    return texelFetch(u_lightBuffer, u_numLights * LIGHT_RECORD_SIZE + curve);
+}
+
+// Samplers can only be indexed by constants when the light varies per pixel
+vec3 sampleLightTex(int slot, vec2 uv, float LOD) {
+    switch (slot) {
+        case 0: return textureLod(u_bezLightTex[0], uv, LOD).rgb;
+        case 1: return textureLod(u_bezLightTex[1], uv, LOD).rgb;
+        case 2: return textureLod(u_bezLightTex[2], uv, LOD).rgb;
+        case 3: return textureLod(u_bezLightTex[3], uv, LOD).rgb;
     }
+    return vec3(1.0);
 }
 
 mat4 bernMat = transpose(mat4(1.0000,    0.0000,    0.0000,    0.0000,   // t = 1
@@ -154,21 +332,18 @@ mat4 invBernMat = transpose(mat4(1.0000,    0.0000,    0.0000,    0.0000,
                                  0.0000,    0.0000,    0.0000,    1.0000));
 
 vec3 bezierCurve(const Bez bez, float t) {
-    // For cubic by de Casteljou's algorithm
-    vec3 A = mix(bez.cps[0], bez.cps[1], t);
-    vec3 B = mix(bez.cps[1], bez.cps[2], t);
-    vec3 C = mix(bez.cps[2], bez.cps[3], t);
-
-    A = mix(A, B, t);
-    B = mix(B, C, t);
-
-    return mix(A, B, t);
+    // Horner's scheme on the power basis
+    return ((bez.coeffs[3] * t + bez.coeffs[2]) * t + bez.coeffs[1]) * t + bez.coeffs[0];
 }
 
+#if CLIP_METHOD == CLIP_BEZIER
 // ----------------------------------------------
 // Bezier clipping
 // ----------------------------------------------
-void giftWrap(Bez tdBez, out int cvxLen, out vec3 cvx[MAX_N_POINTS]) {
+#define BEZCLIP_STACK_SIZE 48  // former MAX_N_POINTS, deeper than a cubic needs
+#define BEZCLIP_BISECT_NUM 16
+
+void giftWrap(Bez tdBez, out int cvxLen, out vec3 cvx[NUM_CPS_IN_CURVE]) {
     // Assume control points are on a plane.
     // Compute principal axes
     vec3 e0 = normalize(tdBez.cps[0] - tdBez.cps[1]);
@@ -181,7 +356,7 @@ void giftWrap(Bez tdBez, out int cvxLen, out vec3 cvx[MAX_N_POINTS]) {
     vec3 xAxis = cross(tmp, n);
     vec3 yAxis = cross(n, xAxis);
 
-    vec2 pts[MAX_N_POINTS];
+    vec2 pts[NUM_CPS_IN_CURVE];
     for (int i = 0; i < NUM_CPS_IN_CURVE; i++) {
         pts[i] = vec2(dot(xAxis, tdBez.cps[i]), dot(yAxis, tdBez.cps[i]));
         cvx[i] = vec3(0.0, 0.0, 0.0);
@@ -195,7 +370,7 @@ void giftWrap(Bez tdBez, out int cvxLen, out vec3 cvx[MAX_N_POINTS]) {
         }
     }
 
-    int idx[MAX_N_POINTS];
+    int idx[NUM_CPS_IN_CURVE];
     int count = 0;
     for (int i = 0; i < NUM_CPS_IN_CURVE; i++) {
         idx[count] = a;
@@ -248,7 +423,7 @@ void bezierClipping(const Bez trBez, out int config, out int count, out float ts
     }
 
     /***** Bezier clipping *****/
-    vec2 stk[MAX_N_POINTS];
+    vec2 stk[BEZCLIP_STACK_SIZE];
     int stkIndex = 0;
     stk[stkIndex++] = vec2(0.0, 1.0); // initialization, push to stack
 
@@ -280,7 +455,7 @@ void bezierClipping(const Bez trBez, out int config, out int count, out float ts
 
             // 2. compute convex hull
             int cvxLen; // number of points generating the convex hull
-            vec3 cvx[MAX_N_POINTS];
+            vec3 cvx[NUM_CPS_IN_CURVE];
             giftWrap(tdBez, cvxLen, cvx);
 
             // 3. update tMin and tMax
@@ -322,11 +497,28 @@ void bezierClipping(const Bez trBez, out int config, out int count, out float ts
         }
 
         // found intersection
-        if (split) {
+        if (split && stkIndex + 2 <= BEZCLIP_STACK_SIZE) {
             float tMid = 0.5 * (tMin + tMax);
             stk[stkIndex++] = vec2(tMin, tMid);
             stk[stkIndex++] = vec2(tMid, tMax);
-        } else if (isect) {
+        } else if (split) {
+            // stack is full: keep bisecting the current interval on the sign
+            // of the curve, and record a root only if a sign change was kept
+            float zMin = bezierCurve(trBez, tMin).z;
+            for (int i = 0; i < BEZCLIP_BISECT_NUM; i++) {
+                float tMid = 0.5 * (tMin + tMax);
+                float zMid = bezierCurve(trBez, tMid).z;
+                if (sign(zMin) * sign(zMid) <= 0.0) {
+                    tMax = tMid;
+                } else {
+                    tMin = tMid;
+                    zMin = zMid;
+                }
+            }
+            if (sign(zMin) * sign(bezierCurve(trBez, tMax).z) <= 0.0 && count < NUM_INTERSECTION_MAX) {
+                ts[count++] = 0.5 * (tMin + tMax);
+            }
+        } else if (isect && count < NUM_INTERSECTION_MAX) {
             ts[count++] = 0.5 * (tMin + tMax);
         }
     }
@@ -334,6 +526,7 @@ void bezierClipping(const Bez trBez, out int config, out int count, out float ts
     // if successfully clipped
     if (count >= 1 ) { config = 2; }
 }
+#endif // CLIP_METHOD == CLIP_BEZIER
 
 // ----------------------------------------------
 // Algebraic clipping
@@ -380,9 +573,10 @@ void solveLinear(const float a, const float b,
 void solveQuadratic(const float a, const float b, const float c,
                     inout int count, inout float ts[NUM_INTERSECTION_MAX]) {
     float D = b * b - 4.0 * a * c;
-    if (D > 0.0) { // two distinct real roots
+    if (D > 0.0) { // two distinct real roots, in descending order like the cubic ones
         float sqrtD = sqrt(D);
-        vec2 tt = -b + vec2(-1, 1) * sqrtD / (2.0 * a);
+        vec2 tt = (-b + vec2(-1, 1) * sqrtD) / (2.0 * a);
+        tt = vec2(min(tt.x, tt.y), max(tt.x, tt.y));
         if (check01(tt.y)) { ts[count++] = tt.y; }
         if (check01(tt.x)) { ts[count++] = tt.x; }
     }
@@ -468,22 +662,176 @@ void algebraicClipping(const Bez trBez, inout int config,
     }
 
     //*****algebraic clipping*****//
-    float P0z = trBez.cps[0].z;
-    float P1z = trBez.cps[1].z;
-    float P2z = trBez.cps[2].z;
-    float P3z = trBez.cps[3].z;
-
     // at^3 + bt^2 + ct + d = 0
-    float a = -P0z + 3.0 * P1z - 3.0 * P2z + P3z;
-    float b = 3.0 * (P0z - 2.0 * P1z + P2z);
-    float c = 3.0 * (-P0z + P1z);
-    float d = P0z;
+    float a = trBez.coeffs[3].z;
+    float b = trBez.coeffs[2].z;
+    float c = trBez.coeffs[1].z;
+    float d = trBez.coeffs[0].z;
 
     solveEquation(a, b, c, d, count, ts);
     if (count >= 1) { config = 2; }
     else { config = (bezierCurve(trBez, 0.5).z > 0.0) ? 1 : 3; } // if count == 0
 }
 
+// Lines and quadratics, whose higher coefficients are exactly zero (see
+// BezierLightSet::upload), are clipped in closed form whatever CLIP_METHOD is
+void lowDegreeClipping(const Bez trBez, out int config, out int count, out float ts[NUM_INTERSECTION_MAX]) {
+    count = 0;
+
+    // check cases that do not need clipping
+    int numCpsUnder = 0;
+    for (int i = 0; i < NUM_CPS_IN_CURVE; i++) {
+        numCpsUnder += (trBez.cps[i].z < 0.0) ? 1 : 0;
+    }
+
+    if (numCpsUnder == 0) {
+        config = 0;
+        return;
+    }
+    else if (numCpsUnder == NUM_CPS_IN_CURVE) {
+        config = 4;
+        return;
+    }
+
+    float b = trBez.coeffs[2].z;
+    float c = trBez.coeffs[1].z;
+    float d = trBez.coeffs[0].z;
+    if (trBez.degree == 2 && b != 0.0) {
+        solveQuadratic(b, c, d, count, ts);
+    } else if (c != 0.0) {
+        solveLinear(c, d, count, ts);
+    }
+    if (count >= 1) { config = 2; }
+    else { config = (bezierCurve(trBez, 0.5).z > 0.0) ? 1 : 3; }
+}
+
+#if CLIP_METHOD == CLIP_NEWTON
+// ----------------------------------------------
+// Newton's method on bracketed intervals
+// ----------------------------------------------
+#define NEWTON_ITERATIONS 10
+
+// Root of z(t) = z.x + z.y t + z.z t^2 + z.w t^3 in [t0, t1], where z
+// changes sign. Steps that would leave the bracket bisect it instead, so the
+// root cannot be lost, and every step shrinks the bracket. The bracket is
+// closed, as a converged step lands on the end it has just moved.
+float newtonBracketed(const vec4 z, float t0, float t1) {
+    bool isNegative0 = ((z.w * t0 + z.z) * t0 + z.y) * t0 + z.x < 0.0;
+    float t = 0.5 * (t0 + t1);
+    for (int i = 0; i < NEWTON_ITERATIONS; i++) {
+        float f = ((z.w * t + z.z) * t + z.y) * t + z.x;
+        float df = (3.0 * z.w * t + 2.0 * z.z) * t + z.y;
+        if ((f < 0.0) == isNegative0) {
+            t0 = t;
+        } else {
+            t1 = t;
+        }
+        float tNext = t - f / df;
+        t = (df != 0.0 && t0 <= tNext && tNext <= t1) ? tNext : 0.5 * (t0 + t1);
+    }
+    return t;
+}
+
+// Same configs and root order as algebraicClipping. [0, 1] is split at the
+// extrema of z, so that each piece holds at most one root, found where z
+// changes sign over the piece.
+void newtonClipping(const Bez trBez, out int config, out int count, out float ts[NUM_INTERSECTION_MAX]) {
+    count = 0;
+
+    // check cases that do not need clipping
+    int numCpsUnder = 0;
+    for (int i = 0; i < NUM_CPS_IN_CURVE; i++) {
+        numCpsUnder += (trBez.cps[i].z < 0.0) ? 1 : 0;
+    }
+
+    if (numCpsUnder == 0) {
+        config = 0;
+        return;
+    }
+    else if (numCpsUnder == NUM_CPS_IN_CURVE) {
+        config = 4;
+        return;
+    }
+
+    vec4 z = vec4(trBez.coeffs[0].z, trBez.coeffs[1].z, trBez.coeffs[2].z, trBez.coeffs[3].z);
+
+    // extrema at the roots of z' = 3 z.w t^2 + 2 z.z t + z.y
+    vec2 extrema = vec2(-1.0);
+    float qa = 3.0 * z.w;
+    float qb = 2.0 * z.z;
+    float qc = z.y;
+    float D = qb * qb - 4.0 * qa * qc;
+    if (qa != 0.0 && D > 0.0) {
+        // stable form, without cancellation between qb and sqrt(D)
+        float q = -0.5 * (qb + (qb < 0.0 ? -1.0 : 1.0) * sqrt(D));
+        extrema = vec2(q / qa, q != 0.0 ? qc / q : -1.0);
+        extrema = vec2(min(extrema.x, extrema.y), max(extrema.x, extrema.y));
+    } else if (qa == 0.0 && qb != 0.0) {
+        extrema.x = -qc / qb;
+    }
+
+    float bounds[4];
+    int numBounds = 0;
+    bounds[numBounds++] = 0.0;
+    if (0.0 < extrema.x && extrema.x < 1.0) { bounds[numBounds++] = extrema.x; }
+    if (0.0 < extrema.y && extrema.y < 1.0) { bounds[numBounds++] = extrema.y; }
+    bounds[numBounds++] = 1.0;
+
+    // from the last piece, so that roots come in descending order
+    for (int k = numBounds - 1; k > 0; k--) {
+        float t0 = bounds[k - 1];
+        float t1 = bounds[k];
+        float z0 = ((z.w * t0 + z.z) * t0 + z.y) * t0 + z.x;
+        float z1 = ((z.w * t1 + z.z) * t1 + z.y) * t1 + z.x;
+        if ((z0 < 0.0) != (z1 < 0.0)) {
+            ts[count++] = newtonBracketed(z, t0, t1);
+        }
+    }
+
+    if (count >= 1) { config = 2; }
+    else { config = (bezierCurve(trBez, 0.5).z > 0.0) ? 1 : 3; }
+}
+#endif // CLIP_METHOD == CLIP_NEWTON
+
+#ifdef SHOW_ROOT_ERROR
+// ----------------------------------------------
+// accuracy of the horizon clipping
+// ----------------------------------------------
+#define ROOT_CHECK_SAMPLES 64
+
+float rootErrorMax = 0.0;  // largest error in t of a root found in this pixel
+int rootsMissed = 0;       // sign changes of z without a root found
+bool hasRoots = false;
+
+// The error in t of each root is estimated by one Newton step, |z / z'|.
+// Sign changes of z over ROOT_CHECK_SAMPLES samples count the roots that
+// should have been found.
+void accumulateRootError(const Bez trBez, const int config, const int count, const float ts[NUM_INTERSECTION_MAX]) {
+    if (config == 0 || config == 4) {
+        return;
+    }
+    hasRoots = true;
+
+    vec4 z = vec4(trBez.coeffs[0].z, trBez.coeffs[1].z, trBez.coeffs[2].z, trBez.coeffs[3].z);
+    for (int i = 0; i < count; i++) {
+        float t = ts[i];
+        float f = ((z.w * t + z.z) * t + z.y) * t + z.x;
+        float df = (3.0 * z.w * t + 2.0 * z.z) * t + z.y;
+        rootErrorMax = max(rootErrorMax, min(abs(f) / max(abs(df), 1.0e-12), 1.0));
+    }
+
+    int signChanges = 0;
+    bool wasNegative = z.x < 0.0;
+    for (int k = 1; k <= ROOT_CHECK_SAMPLES; k++) {
+        float t = float(k) / ROOT_CHECK_SAMPLES;
+        bool isNegative = ((z.w * t + z.z) * t + z.y) * t + z.x < 0.0;
+        signChanges += isNegative != wasNegative ? 1 : 0;
+        wasNegative = isNegative;
+    }
+    rootsMissed += max(signChanges - count, 0);
+}
+#endif // SHOW_ROOT_ERROR
+
 // ----------------------------------------------
 // line & curve integration in LTC
 // ----------------------------------------------
@@ -508,6 +856,21 @@ void transformToCC(const vec3 P, const mat3 CCmat, const Bez bez, inout Bez trBe
     for (int i = 0; i < NUM_CPS_IN_CURVE; i++) {
         trBez.cps[i] = CCmat * (bez.cps[i] - P);
     }
+
+    // only the constant term is a point, the others are directions
+    trBez.coeffs[0] = trBez.cps[0];
+    for (int i = 1; i < NUM_CPS_IN_CURVE; i++) {
+        trBez.coeffs[i] = CCmat * bez.coeffs[i];
+    }
+    trBez.degree = bez.degree;
+}
+
+// True if the sphere lies entirely below the horizon (z = 0 in CC space).
+// The z coordinate of a point X in CC space is dot(h, X - P), h being the
+// third row of CCmat, so it varies by at most |h| * radius over the sphere.
+bool isBelowHorizon(const vec3 P, const mat3 CCmat, const vec4 sphere) {
+    vec3 h = vec3(CCmat[0][2], CCmat[1][2], CCmat[2][2]);
+    return dot(h, sphere.xyz - P) < -sphere.w * length(h);
 }
 
 float integrateEdge(const vec3 v0, const vec3 v1) {
@@ -534,20 +897,19 @@ float DPintegration(const Bez trBez, const float tStart, const float tEnd, const
     float res = 0.0;
     
     // if line
-    vec3 v01 = trBez.cps[1] - trBez.cps[0];
-    vec3 v02 = trBez.cps[2] - trBez.cps[0];
-    vec3 v03 = trBez.cps[3] - trBez.cps[0];
-    if (abs(dot(v01, v02)) < EPS && abs(dot(v01, v03)) < EPS) {
+    if (trBez.degree == 1) {
         vec3 v0 = bezierCurve(trBez, tStart);
         vec3 v3 = bezierCurve(trBez, tEnd);
         res = integrateEdge(v0, v3);
+        edgeNum++;
         return res;
     }
 
-    // initialization
+    // initialization (clipped parts get half the divisions, at least one)
+    int numDiv = clamp(div, 1, DP_STACK_SIZE / 2);
     float tRange = tEnd - tStart;
-    float interval = tRange / div;
-    for (int i = div; i > 0; i--) {
+    float interval = tRange / numDiv;
+    for (int i = numDiv; i > 0; i--) {
         // in descending order
         int j = i - 1;
         float tMin = interval * j + tStart;
@@ -573,7 +935,9 @@ float DPintegration(const Bez trBez, const float tStart, const float tEnd, const
         float Iz = I01z + I12z + I20z;
         float relD = dist012(v0, v1, v2) / length(v2 - v0);
         
-        if (abs(Iz) >= thres && relD > 0.01) { // if A is larger than threshold, add tMid to stack and repeat the loop
+        // the stack bounds the depth, beyond it the triangle is accepted as is
+        bool canSplit = DPstkIndex + 2 <= DP_STACK_SIZE;
+        if (abs(Iz) >= thres && relD > 0.01 && canSplit) { // if A is larger than threshold, add tMid to stack and repeat the loop
             DPstk[DPstkIndex++] = vec2(tMid, tMax);
             DPstk[DPstkIndex++] = vec2(tMin, tMid);
         } else {
@@ -585,34 +949,171 @@ float DPintegration(const Bez trBez, const float tStart, const float tEnd, const
     return res;
 }
 
+#ifdef GAUSS_ORDER
+// ----------------------------------------------
+// Gauss-Legendre quadrature
+// ----------------------------------------------
+// positive half of the nodes on [-1, 1], the others are mirrored
+#if GAUSS_ORDER == 4
+const float GAUSS_X[2] = float[2](0.3399810435848563, 0.8611363115940526);
+const float GAUSS_W[2] = float[2](0.6521451548625461, 0.3478548451374538);
+#elif GAUSS_ORDER == 8
+const float GAUSS_X[4] = float[4](0.1834346424956498, 0.5255324099163290, 0.7966664774136267, 0.9602898564975363);
+const float GAUSS_W[4] = float[4](0.3626837833783620, 0.3137066458778873, 0.2223810344533745, 0.1012285362903763);
+#elif GAUSS_ORDER == 16
+const float GAUSS_X[8] = float[8](0.0950125098376374, 0.2816035507792589, 0.4580167776572274, 0.6178762444026438,
+                                  0.7554044083550030, 0.8656312023878318, 0.9445750230732326, 0.9894009349916499);
+const float GAUSS_W[8] = float[8](0.1894506104550685, 0.1826034150449236, 0.1691565193950025, 0.1495959888165767,
+                                  0.1246289712555339, 0.0951585116824928, 0.0622535239386479, 0.0271524594117541);
+#else
+#error GAUSS_ORDER must be 4, 8 or 16
+#endif
+
+// Contour integral of the curve from tStart to tEnd, which is the limit of
+// integrateEdge summed over ever shorter chords:
+//   integral of cross(p, dp/dt).z / dot(p, p) dt
+// Every curve takes the same GAUSS_ORDER evaluations, so neighbouring pixels
+// run the same loop and no stack is needed.
+float gaussIntegration(const Bez trBez, const float tStart, const float tEnd, inout int edgeNum) {
+    if (trBez.degree == 1) {
+        edgeNum++;
+        return integrateEdge(bezierCurve(trBez, tStart), bezierCurve(trBez, tEnd));
+    }
+
+    float tMid = 0.5 * (tStart + tEnd);
+    float halfRange = 0.5 * (tEnd - tStart);
+    float res = 0.0;
+    for (int i = 0; i < GAUSS_ORDER / 2; i++) {
+        for (int side = -1; side <= 1; side += 2) {
+            float t = tMid + side * halfRange * GAUSS_X[i];
+            vec3 p = bezierCurve(trBez, t);
+            vec3 dp = (3.0 * trBez.coeffs[3] * t + 2.0 * trBez.coeffs[2]) * t + trBez.coeffs[1];
+            res += GAUSS_W[i] * cross(p, dp).z / dot(p, p);
+        }
+    }
+    edgeNum += GAUSS_ORDER;
+    return res * halfRange;
+}
+#endif // GAUSS_ORDER
+
+#ifdef UNIFORM_CHORDS
+// Reference for the other integrators (see --bench in main.cpp): many equal
+// chords, each integrated exactly, which stays accurate where the integrand
+// peaks sharply close to the shading point
+float chordIntegration(const Bez trBez, const float tStart, const float tEnd, inout int edgeNum) {
+    float res = 0.0;
+    vec3 v0 = bezierCurve(trBez, tStart);
+    for (int i = 1; i <= UNIFORM_CHORDS; i++) {
+        vec3 v1 = bezierCurve(trBez, mix(tStart, tEnd, float(i) / UNIFORM_CHORDS));
+        res += integrateEdge(v0, v1);
+        v0 = v1;
+    }
+    edgeNum += UNIFORM_CHORDS;
+    return res;
+}
+#endif // UNIFORM_CHORDS
+
+// Integral along a curve segment with the integrator of the variant
+float integrateCurve(const Bez trBez, const float tStart, const float tEnd, const int div, const float thres, inout int edgeNum) {
+#if defined(UNIFORM_CHORDS)
+    return chordIntegration(trBez, tStart, tEnd, edgeNum);
+#elif defined(GAUSS_ORDER)
+    return gaussIntegration(trBez, tStart, tEnd, edgeNum);
+#else
+    return DPintegration(trBez, tStart, tEnd, div, thres, edgeNum);
+#endif
+}
+
+// ----------------------------------------------
+// subdivision policy
+// ----------------------------------------------
+#define FIXED_NUM_DIV 4
+#define ADAPTIVE_MIN_DIV 2  // a single chord misses S-shaped curves, whose triangle cancels out
+#define ADAPTIVE_MAX_DIV 8
+#define FOOTPRINT_REF 0.02  // footprint (world units) below which the threshold is not relaxed
+#define LOD_ANGLE_SCALE 0.01  // shape error allowed, in radians per unit of lobe width
+
+// Initial divisions and DP threshold scale for one light seen from P.
+// Divisions follow the solid angle of the bounding sphere, so that distant or
+// small lights get ADAPTIVE_MIN_DIV per curve and large, near ones up to
+// ADAPTIVE_MAX_DIV. The threshold is relaxed for pixels covering a large area
+// (distant or grazing), whose error is averaged away.
+void adaptiveSubdiv(const vec3 P, const vec3 N, const Light light, out int nDiv, out float thresScale) {
+    vec3 toLight = light.sphere.xyz - P;
+    float dist2 = dot(toLight, toLight);
+    float r2 = light.sphere.w * light.sphere.w;
+    // solid angle of the sphere over 2 PI
+    float omega = dist2 > r2 ? 1.0 - sqrt(1.0 - r2 / dist2) : 1.0;
+    nDiv = clamp(int(ceil(ADAPTIVE_MAX_DIV * sqrt(omega))), ADAPTIVE_MIN_DIV, ADAPTIVE_MAX_DIV);
+
+#ifdef LIGHTMAP_BAKE
+    // the lightmap is not rebaked when the camera moves, so it must not
+    // depend on the view
+    thresScale = 1.0;
+#else
+    vec3 toEye = u_cameraPos - P;
+    float dist = length(toEye);
+    float footprint = dist * u_pixelAngle / max(dot(N, toEye) / dist, 0.1);
+    thresScale = clamp(footprint / FOOTPRINT_REF, 1.0, 4.0);
+#endif
+}
+
 // ----------------------------------------------
 // diffuse & specular reflectance evaluation
 // ----------------------------------------------
-float evaluateLTCspec(vec3 P, const float alpha, const int nDiv, mat3 specCCmat, const BezierLight bezLight, bool twoSided, inout int edgeNum) {
+float evaluateLTCspec(vec3 P, const float thres, const int nDiv, mat3 specCCmat, const Light light, inout int edgeNum) {
     // integrate each curve
     float spec = 0.0;
-    float thres = 0.1 * alpha * alpha; // alpha-based threshold
+    // clipped pieces get half the divisions, but no fewer than ADAPTIVE_MIN_DIV
+    int nPieceDiv = max(nDiv / 2, ADAPTIVE_MIN_DIV);
 
     bool hasBegin = false;
     vec3 vBegin = vec3(0.0);
     bool hasEnd = false;
     vec3 vEnd = vec3(0.0);
 
-    BezierLight trBezLight;
-    for (int curve = 0; curve < u_numCurves; curve++) {
+    // nothing to clip or integrate if the whole light is below the horizon
+    if (isBelowHorizon(P, specCCmat, light.sphere)) {
+        return 0.0;
+    }
+
+    for (int curve = light.firstCurve; curve < light.firstCurve + light.numCurves; curve++) {
+        // same as configs >= 3 below, without fetching or clipping the curve
+        if (isBelowHorizon(P, specCCmat, fetchCurveSphere(curve))) {
+            continue;
+        }
+
+        Bez trBez;
         int configs; // array for detecting integration configs
         int counts; // number of intersections in each curve
         float ts[NUM_INTERSECTION_MAX]; // 2D array that stores all intesrctions
-        transformToCC(P, specCCmat, bezLight.bezs[curve], trBezLight.bezs[curve]);
+        transformToCC(P, specCCmat, fetchBez(curve), trBez);
 
-        // clipping methods, use either of these
-        //bezierClipping(trBezLight.bezs[curve], configs[curve], counts[curve], ts[curve]);
-        algebraicClipping(trBezLight.bezs[curve], configs, counts, ts);
+        // clipping method of cubics is selected by CLIP_METHOD
+        if (trBez.degree < 3) {
+            lowDegreeClipping(trBez, configs, counts, ts);
+        } else {
+#if CLIP_METHOD == CLIP_BEZIER
+            bezierClipping(trBez, configs, counts, ts);
+#elif CLIP_METHOD == CLIP_NEWTON
+            newtonClipping(trBez, configs, counts, ts);
+#else
+            algebraicClipping(trBez, configs, counts, ts);
+#endif
+        }
+#ifdef SHOW_ROOT_ERROR
+        accumulateRootError(trBez, configs, counts, ts);
+#endif
+#ifdef COST_METRIC
+        costCurves++;
+        costCrossings += configs == 2 ? 1 : 0;
+        costRoots += counts;
+#endif
 
         if (configs <= 1) {
             // 0: all cps above surface, integrate all
             // 1: entire curve above surface, integrate all
-            spec += DPintegration(trBezLight.bezs[curve], 0.0, 1.0, nDiv, thres, edgeNum);
+            spec += integrateCurve(trBez, 0.0, 1.0, nDiv, thres, edgeNum);
         } else if (configs >= 3) {
             // 3: entire curve below surface, no integration
             // 4: all cps below surface, no integration
@@ -626,21 +1127,21 @@ float evaluateLTCspec(vec3 P, const float alpha, const int nDiv, mat3 specCCmat,
 
                 case 1:
                     t0 = ts[0];
-                    if (bezierCurve(trBezLight.bezs[curve], 0.5 * t0).z > 0.0) {
+                    if (bezierCurve(trBez, 0.5 * t0).z > 0.0) {
                         // start point is above surface
-                        spec += DPintegration(trBezLight.bezs[curve], 0.0, t0, nDiv / 2, thres, edgeNum);
-                        vEnd = bezierCurve(trBezLight.bezs[curve], t0);
+                        spec += integrateCurve(trBez, 0.0, t0, nPieceDiv, thres, edgeNum);
+                        vEnd = bezierCurve(trBez, t0);
                         hasEnd = true;
                     } else {
                         // end point is above surface
-                        spec += DPintegration(trBezLight.bezs[curve], t0, 1.0, nDiv / 2, thres, edgeNum);
+                        spec += integrateCurve(trBez, t0, 1.0, nPieceDiv, thres, edgeNum);
                         if (hasEnd) {
-                            vec3 v0 = bezierCurve(trBezLight.bezs[curve], t0);
+                            vec3 v0 = bezierCurve(trBez, t0);
                             spec += integrateEdge(vEnd, v0);
                             vEnd = vec3(0.0);
                             hasEnd = false;
                         } else {
-                            vBegin = bezierCurve(trBezLight.bezs[curve], t0);
+                            vBegin = bezierCurve(trBez, t0);
                             hasBegin = true;
                         }
                     }
@@ -650,33 +1151,33 @@ float evaluateLTCspec(vec3 P, const float alpha, const int nDiv, mat3 specCCmat,
                     // flip order: "ts[curve][1] < ts[curve][0]" -> "t0 < t1"
                     t0 = ts[1];
                     t1 = ts[0];
-                    if (bezierCurve(trBezLight.bezs[curve], 0.5 * (t0 + t1)).z > 0.0) { // if mid point is above surface
+                    if (bezierCurve(trBez, 0.5 * (t0 + t1)).z > 0.0) { // if mid point is above surface
                         // integrate t0 -> t1
-                        spec += DPintegration(trBezLight.bezs[curve], t0, t1, nDiv / 2, thres, edgeNum);
+                        spec += integrateCurve(trBez, t0, t1, nPieceDiv, thres, edgeNum);
 
                         if (hasEnd) {
-                            vec3 v0 = bezierCurve(trBezLight.bezs[curve], t0);
+                            vec3 v0 = bezierCurve(trBez, t0);
                             spec += integrateEdge(vEnd, v0);
                             vEnd = vec3(0.0);
                             hasEnd = false;
                         } else {
-                            vBegin = bezierCurve(trBezLight.bezs[curve], t0);
+                            vBegin = bezierCurve(trBez, t0);
                             hasBegin = true;
                         }
 
-                        vEnd = bezierCurve(trBezLight.bezs[curve], t1);
+                        vEnd = bezierCurve(trBez, t1);
                         hasEnd = true;
                     } else { // if mid point is below surface
                         // integrate 0.0 -> t0
-                        spec += DPintegration(trBezLight.bezs[curve], 0.0, t0, nDiv / 2, thres, edgeNum);
+                        spec += integrateCurve(trBez, 0.0, t0, nPieceDiv, thres, edgeNum);
 
                         // integrate edge t0 -> t1 (connect t0 and t1)
-                        vec3 v0 = bezierCurve(trBezLight.bezs[curve], t0);
-                        vec3 v1 = bezierCurve(trBezLight.bezs[curve], t1);
+                        vec3 v0 = bezierCurve(trBez, t0);
+                        vec3 v1 = bezierCurve(trBez, t1);
                         spec += integrateEdge(v0, v1);
 
                         // integrate t1 -> 1.0
-                        spec += DPintegration(trBezLight.bezs[curve], t1, 1.0, nDiv / 2, thres, edgeNum);
+                        spec += integrateCurve(trBez, t1, 1.0, nPieceDiv, thres, edgeNum);
                     }
                     break;
 
@@ -685,19 +1186,19 @@ float evaluateLTCspec(vec3 P, const float alpha, const int nDiv, mat3 specCCmat,
                     t0 = ts[2];
                     t1 = ts[1];
                     t2 = ts[0];
-                    if (bezierCurve(trBezLight.bezs[curve], 0.5 * (t0 + t1)).z > 0.0) { // if 0.5(t0 + t1) is above surface
+                    if (bezierCurve(trBez, 0.5 * (t0 + t1)).z > 0.0) { // if 0.5(t0 + t1) is above surface
                         // integrate t0 -> t1
-                        spec += DPintegration(trBezLight.bezs[curve], t0, t1, nDiv / 2, thres, edgeNum);
+                        spec += integrateCurve(trBez, t0, t1, nPieceDiv, thres, edgeNum);
 
                         // integrate edge t1 -> t2 (connect t1 and t2)
-                        vec3 v1 = bezierCurve(trBezLight.bezs[curve], t1);
-                        vec3 v2 = bezierCurve(trBezLight.bezs[curve], t2);
+                        vec3 v1 = bezierCurve(trBez, t1);
+                        vec3 v2 = bezierCurve(trBez, t2);
                         spec += integrateEdge(v1, v2);
 
                         // integrate t2 -> 1.0
-                        spec += DPintegration(trBezLight.bezs[curve], t2, 1.0, nDiv / 2, thres, edgeNum);
+                        spec += integrateCurve(trBez, t2, 1.0, nPieceDiv, thres, edgeNum);
 
-                        vec3 v0 = bezierCurve(trBezLight.bezs[curve], t0);
+                        vec3 v0 = bezierCurve(trBez, t0);
                         if (hasEnd) {
                             spec += integrateEdge(vEnd, v0);
                             vEnd = vec3(0.0);
@@ -708,17 +1209,17 @@ float evaluateLTCspec(vec3 P, const float alpha, const int nDiv, mat3 specCCmat,
                         }
                     } else {
                         // integrate 0.0 -> t0
-                        spec += DPintegration(trBezLight.bezs[curve], 0.0, t0, nDiv / 2, thres, edgeNum);
+                        spec += integrateCurve(trBez, 0.0, t0, nPieceDiv, thres, edgeNum);
 
                         // integrate edge t0 -> t1 (connect t0 and t1)
-                        vec3 v0 = bezierCurve(trBezLight.bezs[curve], t0);
-                        vec3 v1 = bezierCurve(trBezLight.bezs[curve], t1);
+                        vec3 v0 = bezierCurve(trBez, t0);
+                        vec3 v1 = bezierCurve(trBez, t1);
                         spec += integrateEdge(v0, v1);
 
                         // integrate t1 -> t2
-                        spec += DPintegration(trBezLight.bezs[curve], t1, t2, nDiv / 2, thres, edgeNum);
+                        spec += integrateCurve(trBez, t1, t2, nPieceDiv, thres, edgeNum);
 
-                        vEnd = bezierCurve(trBezLight.bezs[curve], t2);
+                        vEnd = bezierCurve(trBez, t2);
                         hasEnd = true;
                     }
                     break;
@@ -730,9 +1231,10 @@ float evaluateLTCspec(vec3 P, const float alpha, const int nDiv, mat3 specCCmat,
         spec += integrateEdge(vEnd, vBegin);
     }
 
-    return u_isTwoSided ? abs(spec) : max(0.0, spec);
+    return light.twoSided ? abs(spec) : max(0.0, spec);
 }
 
+#if CLIP_METHOD == CLIP_POLYGON
 vec3 surfaceIntersection(const vec3 v0, const vec3 v1) {
     vec3 dir = v1 - v0;
     float invdir_z = 1.0 / (abs(dir.z) + EPS) * sign(dir.z);    
@@ -740,26 +1242,37 @@ vec3 surfaceIntersection(const vec3 v0, const vec3 v1) {
     return res;
 }
 
-float evaluateLTCspec_simple(vec3 P, const int nDiv, mat3 specCCmat, const BezierLight bezLight, bool twoSided) {
-    BezierLight trBezLight;
-    for (int curve = 0; curve < u_numCurves; curve++) {
-        transformToCC(P, specCCmat, bezLight.bezs[curve], trBezLight.bezs[curve]);
-    }
-
+float evaluateLTCspec_simple(vec3 P, const int nDiv, mat3 specCCmat, const Light light) {
     float spec = 0.0;
     bool hasBegin = false;
     vec3 vBegin = vec3(0.0);
     bool hasEnd = false;
     vec3 vEnd = vec3(0.0);
-    for (int curve = 0; curve < u_numCurves; curve++) {
-        float dt = 1.0 / nDiv;
+    if (isBelowHorizon(P, specCCmat, light.sphere)) {
+        return 0.0;
+    }
+
+    for (int curve = light.firstCurve; curve < light.firstCurve + light.numCurves; curve++) {
+        if (isBelowHorizon(P, specCCmat, fetchCurveSphere(curve))) {
+            continue;
+        }
 
-        for (int div = 0; div < nDiv; div++) {
+        Bez trBez;
+        transformToCC(P, specCCmat, fetchBez(curve), trBez);
+#ifdef COST_METRIC
+        costCurves++;
+#endif
+
+        // a line is its own single chord
+        int numChords = trBez.degree == 1 ? 1 : nDiv;
+        float dt = 1.0 / numChords;
+
+        for (int div = 0; div < numChords; div++) {
             float t0 = div * dt;
             float t1 = (div + 1) * dt;
 
-            vec3 v0 = bezierCurve(trBezLight.bezs[curve], t0);
-            vec3 v1 = bezierCurve(trBezLight.bezs[curve], t1);
+            vec3 v0 = bezierCurve(trBez, t0);
+            vec3 v1 = bezierCurve(trBez, t1);
 
             int config;
             if (v0.z > 0.0 && v1.z > 0.0) { config = 0; } // if the whole edge is above surface
@@ -803,40 +1316,129 @@ float evaluateLTCspec_simple(vec3 P, const int nDiv, mat3 specCCmat, const Bezie
         spec += integrateEdge(vEnd, vBegin);
     }
 
-    return u_isTwoSided ? abs(spec) : max(0.0, spec);
+    return light.twoSided ? abs(spec) : max(0.0, spec);
 }
+#endif // CLIP_METHOD == CLIP_POLYGON
 
-float evaluateLTCdiff(vec3 P, mat3 diffCCmat, const BezierLight bL, bool twoSided) {
+float evaluateLTCdiff(vec3 P, mat3 diffCCmat, const Light light) {
     float diff = 0.0;
     int dummy = 0;
-    for (int curve = 0; curve < u_numCurves; curve++) {
+    for (int curve = light.firstCurve; curve < light.firstCurve + light.numCurves; curve++) {
         Bez trBez;
-        transformToCC(P, diffCCmat, bL.bezs[curve], trBez);
+        transformToCC(P, diffCCmat, fetchBez(curve), trBez);
 
         const int DIV = 4;
         const float thres = 1000.0;
-        diff += DPintegration(trBez, 0.0, 1.0, DIV, thres, dummy);
+        diff += integrateCurve(trBez, 0.0, 1.0, DIV, thres, dummy);
+    }
+    return light.twoSided ? abs(diff) : max(0.0, diff);
+}
+
+#ifdef PRECLIPPED_DIFFUSE
+// Diffuse term of a point on the receiver plane. The contour was clipped by
+// that plane on the CPU (see BezierLightSet::upload), which is the horizon of
+// every such point, so it is only transformed and integrated here.
+float evaluateLTCdiff_preclipped(vec3 P, const float thres, const int nDiv, mat3 diffCCmat, const Light light, inout int edgeNum) {
+    float diff = 0.0;
+    for (int segment = 0; segment < light.numSegments; segment++) {
+        int base = light.firstSegment + segment * CURVE_RECORD_SIZE;
+        Bez bez;
+        for (int i = 0; i < NUM_CPS_IN_CURVE; i++) {
+            bez.cps[i] = texelFetch(u_lightBuffer, base + i).xyz;
+            bez.coeffs[i] = texelFetch(u_lightBuffer, base + NUM_CPS_IN_CURVE + i).xyz;
+        }
+        bez.degree = int(texelFetch(u_lightBuffer, base).w);
+        Bez trBez;
+        transformToCC(P, diffCCmat, bez, trBez);
+#ifdef COST_METRIC
+        costCurves++;
+#endif
+
+        // whole curve (1), clipped part (0.5) or edge along the plane (0)
+        float divScale = texelFetch(u_lightBuffer, base + 1).w;
+        if (divScale == 0.0) {
+            diff += integrateEdge(trBez.cps[0], trBez.cps[3]);
+            edgeNum++;
+        } else {
+            diff += integrateCurve(trBez, 0.0, 1.0, max(int(nDiv * divScale), ADAPTIVE_MIN_DIV), thres, edgeNum);
+        }
     }
-    return u_isTwoSided ? abs(diff) : max(0.0, diff);
+    return light.twoSided ? abs(diff) : max(0.0, diff);
 }
+#endif // PRECLIPPED_DIFFUSE
+
+#ifdef POLYGON_FALLBACK
+// ----------------------------------------------
+// polygon LTC of the flattened contour
+// ----------------------------------------------
+#define POLYGON_FADE 0.1  // roughness band over which both integrals are blended
+
+// Polygon clipped by the horizon one edge at a time, as the curves are in
+// evaluateLTCspec. The parts above the horizon are joined along it from each
+// exit point to the next entry point.
+float evaluateLTCpolygon(vec3 P, mat3 CCmat, const Light light, inout int edgeNum) {
+    if (isBelowHorizon(P, CCmat, light.sphere)) {
+        return 0.0;
+    }
+
+    float res = 0.0;
+    bool hasEntry = false;
+    vec3 vFirstEntry = vec3(0.0);
+    bool hasExit = false;
+    vec3 vExit = vec3(0.0);
+
+    int last = light.firstVertex + light.numVertices - 1;
+    vec3 v0 = CCmat * (texelFetch(u_lightBuffer, last).xyz - P);
+    for (int i = light.firstVertex; i <= last; i++) {
+        vec3 v1 = CCmat * (texelFetch(u_lightBuffer, i).xyz - P);
+        if (v0.z > 0.0 && v1.z > 0.0) {
+            res += integrateEdge(v0, v1);
+        } else if (v0.z > 0.0 || v1.z > 0.0) {
+            vec3 vHorizon = mix(v0, v1, v0.z / (v0.z - v1.z));
+            vHorizon.z = 0.0;
+            if (v0.z > 0.0) {
+                res += integrateEdge(v0, vHorizon);
+                vExit = vHorizon;
+                hasExit = true;
+            } else {
+                if (hasExit) {
+                    res += integrateEdge(vExit, vHorizon);
+                } else {
+                    vFirstEntry = vHorizon;
+                    hasEntry = true;
+                }
+                res += integrateEdge(vHorizon, v1);
+            }
+        }
+        v0 = v1;
+    }
+    if (hasEntry && hasExit) {
+        res += integrateEdge(vExit, vFirstEntry);
+    }
+    edgeNum += light.numVertices;
+
+    return light.twoSided ? abs(res) : max(0.0, res);
+}
+#endif // POLYGON_FALLBACK
 
 // UV calculation
-void correctUV(inout vec2 uv) {
-    vec2 texSize = vec2(u_texWidth, u_texHeight);
-    vec2 marginTexSize = texSize + 2 * vec2(u_marginSize);
+void correctUV(inout vec2 uv, const Light light) {
+    vec2 texSize = light.texInfo.xy;
+    vec2 marginTexSize = texSize + 2 * vec2(light.texInfo.z);
     uv *= texSize / marginTexSize;
-    uv += vec2(u_marginSize) / marginTexSize;
+    uv += vec2(light.texInfo.z) / marginTexSize;
 }
 
-void calcUVandLOD(vec3 P, const mat3 CCmat, const float alpha, out vec2 texcoord, out float LOD) {
-    // Bezier curve is defined in [-1, 1] space
-    vec3 leftDown  = CCmat * ((u_bezLightMmat * vec4(-1.0, -1.0, 0.0, 1.0)).xyz - P);
-    vec3 rightDown = CCmat * ((u_bezLightMmat * vec4( 1.0, -1.0, 0.0, 1.0)).xyz - P);
-    vec3 rightUp   = CCmat * ((u_bezLightMmat * vec4( 1.0,  1.0, 0.0, 1.0)).xyz - P);
-    vec3 leftUp    = CCmat * ((u_bezLightMmat * vec4(-1.0,  1.0, 0.0, 1.0)).xyz - P);
+void calcUVandLOD(vec3 P, const mat3 CCmat, const float alpha, const Light light, out vec2 texcoord, out float LOD) {
+    // Bezier curve is defined in [-1, 1] space, whose corners and edges in
+    // world space come with the light record
+    vec3 edgeX = CCmat * light.quadEdgeX;
+    vec3 edgeY = CCmat * light.quadEdgeY;
+    vec3 leftDown = CCmat * (light.quadCorner - P);
+    vec3 rightUp  = leftDown + edgeX + edgeY;
 
-    vec3 invDirX = normalize(rightDown - leftDown);
-    vec3 invDirY = normalize(leftUp - leftDown);
+    vec3 invDirX = normalize(edgeX);
+    vec3 invDirY = normalize(edgeY);
 
     vec3 polygonN = cross(invDirX, invDirY);
     vec3 x0 = vec3(0.0);
@@ -849,24 +1451,74 @@ void calcUVandLOD(vec3 P, const mat3 CCmat, const float alpha, out vec2 texcoord
     vec3 intersectPointLD = intersectPoint - leftDown;
     vec3 intersectPointRU = intersectPoint - rightUp;
 
-    vec3 N01 = normalize(cross(polygonN, rightDown - leftDown));
-    vec3 N03 = normalize(cross(leftUp - leftDown, polygonN));
-    vec3 N12 = normalize(cross(polygonN, rightUp - rightDown));
-    vec3 N32 = normalize(cross(rightUp - leftUp, polygonN));
+    // opposite edges of the parallelogram share their normals
+    vec3 N01 = normalize(cross(polygonN, edgeX));
+    vec3 N03 = normalize(cross(edgeY, polygonN));
 
-    float u = dot(intersectPointLD, N03) / (dot(intersectPointLD, N03) + dot(intersectPointRU, N12));
-    float v = dot(intersectPointLD, N01) / (dot(intersectPointLD, N01) + dot(intersectPointRU, N32));
+    float u = dot(intersectPointLD, N03) / (dot(intersectPointLD, N03) - dot(intersectPointRU, N03));
+    float v = dot(intersectPointLD, N01) / (dot(intersectPointLD, N01) - dot(intersectPointRU, N01));
 
     texcoord = vec2(u, 1.0 - v);
-    correctUV(texcoord);
+    correctUV(texcoord, light);
 
     // LOD calculation
-    vec3 center = 0.25 * (leftDown + rightDown + rightUp + leftUp);
+    vec3 center = leftDown + 0.5 * (edgeX + edgeY);
     float r = length(center); // length between shading point and light center in CC
-    float A = length(cross(rightDown - leftDown, leftUp - leftDown));
+    float A = length(cross(edgeX, edgeY));
     float sigma = 4.0 * r * r * inversesqrt(2.0 * A); // 4.0 * r * r
-    LOD = (sigma + u_maxLOD) * alpha;
+    LOD = (sigma + light.texInfo.w) * alpha;
+}
+
+#ifdef LOWRES_DIFFUSE
+// ----------------------------------------------
+// joint bilateral upsampling
+// The four low-res samples around the pixel are weighted bilinearly and by
+// how well their G-buffer texel matches this pixel: distance from the
+// tangent plane, normal and, for specular, roughness. Returns false when no
+// sample is usable, e.g., along silhouettes.
+// ----------------------------------------------
+bool upsampleLowRes(const ivec2 pixel, const vec3 P, const vec3 N, const float alpha, const bool isSpecular, out vec3 radiance) {
+    ivec2 fullSize = textureSize(u_gPosition, 0);
+    ivec2 lowSize = textureSize(u_lowResDiff, 0);
+    vec2 coord = (vec2(pixel) + 0.5) / float(u_lowResScale) - 0.5;
+    ivec2 base = ivec2(floor(coord));
+    vec2 f = coord - vec2(base);
+
+    float planeScale = 0.01 * length(u_cameraPos - P);
+    vec3 sum = vec3(0.0);
+    float weightSum = 0.0;
+    for (int k = 0; k < 4; k++) {
+        ivec2 offset = ivec2(k & 1, k >> 1);
+        ivec2 lowPixel = clamp(base + offset, ivec2(0), lowSize - 1);
+        ivec2 samplePixel = min(lowPixel * u_lowResScale + u_lowResScale / 2, fullSize - 1);
+
+        vec4 gPosition = texelFetch(u_gPosition, samplePixel, 0);
+        vec4 gNormal = texelFetch(u_gNormal, samplePixel, 0);
+        vec4 value = isSpecular ? texelFetch(u_lowResSpec, lowPixel, 0) : vec4(texelFetch(u_lowResDiff, lowPixel, 0).rgb, 1.0);
+        if (gPosition.w >= 1.0 || value.a == 0.0) {
+            continue;
+        }
+
+        vec2 bilinear = mix(vec2(1.0) - f, f, vec2(offset));
+        float weight = bilinear.x * bilinear.y + 1.0e-4;
+        weight *= exp(-abs(dot(N, gPosition.xyz - P)) / planeScale);
+        weight *= pow(max(dot(N, normalize(gNormal.xyz)), 0.0), 32.0);
+        if (isSpecular) {
+            weight *= exp(-abs(clamp(gNormal.w, 0.01, 1.0) - alpha) / 0.05);
+        }
+
+        sum += weight * value.rgb;
+        weightSum += weight;
+    }
+
+    if (weightSum < 1.0e-3) {
+        radiance = vec3(0.0);
+        return false;
+    }
+    radiance = sum / weightSum;
+    return true;
 }
+#endif // LOWRES_DIFFUSE
 
 // ----------------------------------------------
 // tone mappers
@@ -916,21 +1568,49 @@ vec3 aces_fitted(vec3 color) {
 // main
 // ----------------------------------------------
 void main(void) {
-    BezierLight bL;
-    initBezierLight(bL);
-
+#ifdef DEFERRED
+    // surface attributes of the nearest receiver in this pixel
+#ifdef LOWRES_PASS
+    // the pixel at the center of this block represents it
+    ivec2 pixel = min(ivec2(gl_FragCoord.xy) * u_lowResScale + u_lowResScale / 2, textureSize(u_gPosition, 0) - 1);
+#else
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+#endif
+    vec4 gPosition = texelFetch(u_gPosition, pixel, 0);
+    if (gPosition.w >= 1.0) {
+        discard;
+    }
+    vec4 gNormal = texelFetch(u_gNormal, pixel, 0);
+    gl_FragDepth = gPosition.w;
+
+#ifdef LIGHTMAP
+    // baked diffuse radiance times albedo, already linear (see floorGBuffer.frag)
+    vec3 diffColor = vec3(1.0);
+#else
+    vec3 diffColor = toLinear(texelFetch(u_gDiffuse, pixel, 0).rgb);
+#endif
+    vec3 specColor = toLinear(texelFetch(u_gSpecular, pixel, 0).rgb);
+    vec3 P = gPosition.xyz;
+    vec3 N = normalize(gNormal.xyz);
+    float alpha = gNormal.w;
+#else
     vec3 diffColor = toLinear(vec3(u_diffColor));
     vec3 specColor = toLinear(vec3(u_specColor));
-
-    vec3 color = vec3(0.0);
-
     vec3 P = f_vertPosWorld;
     vec3 N = normalize(f_normalWorld);
+    float alpha = u_alpha;
+    if (ROUGH_TEXTURED) { alpha = texture(u_roughnessTex, f_texcoord).x; }
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+#endif
+
+#ifdef LIGHTMAP_BAKE
+    // diffuse does not depend on the view, any direction off the normal will do
+    vec3 V = normalize(N + (abs(N.x) < 0.9 ? vec3(1.0, 0.0, 0.0) : vec3(0.0, 1.0, 0.0)));
+#else
     vec3 V = normalize(vec3(u_cameraPos) - P);
+#endif
 
     // ltc2.inc uv calculation
-    float alpha = u_alpha;
-    if (u_isRoughTexed) { alpha = texture(u_roughnessTex, f_texcoord).x; }
     alpha = clamp(alpha, 0.01, 1.0);
     float ndotv = clamp(dot(N, V), 0.0, 1.0);
 
@@ -946,36 +1626,193 @@ void main(void) {
     );
 
     int edgeNum = 0;
+    int fixedEdgeNum = 0;  // with FIXED_NUM_DIV, see SHOW_EDGE_SAVING
     mat3 specCCmat = calcCCmat(N, V, P, invM);
-    float spec = evaluateLTCspec(P, alpha, 4, specCCmat, bL, u_isTwoSided, edgeNum) * texture(u_ltcMagTex, uv).x;
+    mat3 diffCCmat = calcCCmat(N, V, P, mat3(1.0));
+    float ltcMag = texture(u_ltcMagTex, uv).x;
+
+    // terms integrated in this pass, the others come from the low-res pass
+    bool isDiffEval = true;
+    bool isSpecEval = true;
+    vec3 diffRadiance = vec3(0.0);
+    vec3 specRadiance = vec3(0.0);
+#ifdef LOWRES_PASS
+    isSpecEval = alpha >= u_lowResSpecAlpha;
+#endif
+#ifdef LIGHTMAP_BAKE
+    isSpecEval = false;
+#endif
+#ifdef LIGHTMAP
+    isDiffEval = false;
+#ifdef DEFERRED
+    diffRadiance = texelFetch(u_gDiffuse, pixel, 0).rgb;
+#else
+    diffRadiance = texture(u_lightmap, f_texcoord).rgb;
+#endif
+#endif
+#ifdef LOWRES_DIFFUSE
+    isDiffEval = !upsampleLowRes(pixel, P, N, alpha, false, diffRadiance);
+    isSpecEval = alpha < u_lowResSpecAlpha || !upsampleLowRes(pixel, P, N, alpha, true, specRadiance);
+#endif
+
+    // accumulate over the light list
+#ifdef TILED_CULLING
+    // only the lights binned into this screen tile
+    ivec2 tile = pixel / LIGHT_TILE_SIZE;
+    uvec2 tileHeader = texelFetch(u_tileHeaders, tile.y * u_numTilesX + tile.x).xy;
+    for (uint k = 0u; k < tileHeader.y; k++) {
+        uint entry = texelFetch(u_tileLights, int(tileHeader.x + k)).x;
+        int i = int(entry & ~TILE_LIGHT_SPECULAR);
+        bool isSpecular = isSpecEval && (entry & TILE_LIGHT_SPECULAR) != 0u;
+#else
+    for (int i = 0; i < u_numLights; i++) {
+        bool isSpecular = isSpecEval;
+#endif
+        if (!isDiffEval && !isSpecular) {
+            continue;
+        }
 
-    // Use only for experiment
-    // Approximate contour curve by simple uniform polygon,
-    // clipping performed by checking intersection for every segment of the curve
-    //float spec = evaluateLTCspec_simple(P, 20, specCCmat, bL, u_isTwoSided) * texture(u_ltcMagTex, uv).x;
+        Light light = fetchLight(i);
 
-    mat3 diffCCmat = calcCCmat(N, V, P, mat3(1.0));
-    float diff = evaluateLTCspec(P, 1.0, 4, diffCCmat, bL, u_isTwoSided, edgeNum);
-    //float diff = evaluateLTCdiff(P, diffCCmat, bL, u_isTwoSided);  // assume light does not cross with the ground
-    //float diff = evaluateLTCspec_simple(P, 4, diffCCmat, bL, u_isTwoSided);
+        // one-sided lights emit nothing towards points behind their plane
+        if (!light.twoSided && dot(light.plane.xyz, P) + light.plane.w <= 0.0) {
+            continue;
+        }
 
-    vec3 specLightColor = vec3(1.0);
-    vec3 diffLightColor = vec3(1.0);
-    if (u_isBezTexed) {
-        vec2 texcoord = vec2(0.0);
-        float LOD = 0;
-        calcUVandLOD(P, specCCmat, alpha, texcoord, LOD);
-        specLightColor = textureLod(u_bezLightTex, texcoord, LOD).rgb;
-        diffLightColor = textureLod(u_bezLightTex, vec2(0.5), u_maxLOD).rgb;
+#if CLIP_METHOD == CLIP_POLYGON
+        // Use only for experiment
+        // Approximate contour curve by simple uniform polygon,
+        // clipping performed by checking intersection for every segment of the curve
+        float spec = isSpecular ? evaluateLTCspec_simple(P, 20, specCCmat, light) * ltcMag : 0.0;
+        float diff = isDiffEval ? evaluateLTCspec_simple(P, 4, diffCCmat, light) : 0.0;
+#else
+        int nDiv = FIXED_NUM_DIV;
+        float thresScale = 1.0;
+#ifdef ADAPTIVE_SUBDIV
+        adaptiveSubdiv(P, N, light, nDiv, thresScale);
+#endif
+        float specThres = 0.1 * alpha * alpha * thresScale; // alpha-based threshold
+        float diffThres = 0.1 * thresScale;
+
+        // the lobe width bounds the shape error that can show in the reflection
+#ifdef LIGHT_LOD
+        Light specLight = selectLightLOD(light, P, LOD_ANGLE_SCALE * alpha);
+        Light diffLight = selectLightLOD(light, P, LOD_ANGLE_SCALE);
+#else
+        Light specLight = light;
+        Light diffLight = light;
+#endif
+
+#ifdef POLYGON_FALLBACK
+        // Curve detail is blurred away in rough reflections, where the
+        // flattened contour is cheaper. Both are blended over a band of
+        // roughness, so that no seam shows where it varies across the floor.
+        float polygonWeight = smoothstep(u_polygonAlpha - POLYGON_FADE, u_polygonAlpha, alpha);
+#else
+        float polygonWeight = 0.0;
+#endif
+        float spec = 0.0;
+        if (isSpecular && polygonWeight < 1.0) {
+            spec = evaluateLTCspec(P, specThres, nDiv, specCCmat, specLight, edgeNum);
+        }
+#ifdef POLYGON_FALLBACK
+        if (isSpecular && polygonWeight > 0.0) {
+            spec = mix(spec, evaluateLTCpolygon(P, specCCmat, light, edgeNum), polygonWeight);
+        }
+#endif
+        spec *= ltcMag;
+#ifdef PRECLIPPED_DIFFUSE
+        float diff = isDiffEval ? evaluateLTCdiff_preclipped(P, diffThres, nDiv, diffCCmat, diffLight, edgeNum) : 0.0;
+#else
+        float diff = isDiffEval ? evaluateLTCspec(P, diffThres, nDiv, diffCCmat, diffLight, edgeNum) : 0.0;
+#endif
+        //float diff = evaluateLTCdiff(P, diffCCmat, light);  // assume light does not cross with the ground
+
+#ifdef SHOW_EDGE_SAVING
+        // the same integrals with the fixed policy, only for counting edges;
+        // same shape levels and polygon fallback, so that only the savings
+        // of adaptive subdivision show
+        if (isSpecular && polygonWeight < 1.0) {
+            evaluateLTCspec(P, 0.1 * alpha * alpha, FIXED_NUM_DIV, specCCmat, specLight, fixedEdgeNum);
+        }
+#ifdef POLYGON_FALLBACK
+        if (isSpecular && polygonWeight > 0.0) {
+            evaluateLTCpolygon(P, specCCmat, light, fixedEdgeNum);
+        }
+#endif
+        if (isDiffEval) {
+#ifdef PRECLIPPED_DIFFUSE
+            evaluateLTCdiff_preclipped(P, 0.1, FIXED_NUM_DIV, diffCCmat, diffLight, fixedEdgeNum);
+#else
+            evaluateLTCspec(P, 0.1, FIXED_NUM_DIV, diffCCmat, diffLight, fixedEdgeNum);
+#endif
+        }
+#endif
+#endif
+
+        vec3 specLightColor = vec3(1.0);
+        vec3 diffLightColor = vec3(1.0);
+        if (BEZ_TEXTURED && light.texSlot >= 0) {
+            if (isSpecular) {
+                vec2 texcoord = vec2(0.0);
+                float LOD = 0;
+                calcUVandLOD(P, specCCmat, alpha, light, texcoord, LOD);
+                specLightColor = sampleLightTex(light.texSlot, texcoord, LOD);
+            }
+            if (isDiffEval) {
+                diffLightColor = sampleLightTex(light.texSlot, vec2(0.5), light.texInfo.w);
+            }
+        }
+        specRadiance += light.Le * specLightColor * spec * INV_TWO_PI;
+        diffRadiance += light.Le * diffLightColor * diff * INV_TWO_PI;
     }
-    color = u_lightLe * (specLightColor * spec * specColor + diffLightColor * diff * diffColor) * INV_TWO_PI;
 
+#if defined(LOWRES_PASS)
+    // radiance without albedo, so that upsampling keeps albedo edges sharp
+    out_color = vec4(diffRadiance, 1.0);
+    out_lowResSpec = isSpecEval ? vec4(specRadiance, 1.0) : vec4(0.0);
+#elif defined(LIGHTMAP_BAKE)
+    out_color = vec4(diffRadiance, 1.0);
+#else
+    vec3 color = specRadiance * specColor + diffRadiance * diffColor;
     color = clamp(color, vec3(0.0), vec3(1.0));
     color = toSRGB(color);
 
     out_color = vec4(color, 1.0);
 
-    // color mapping, uncomment if needed
-    //const int colorIndex = int(clamp(edgeNum / 256.0 * 256, 0, 255));
-    //out_color = vec4(vec3(cmap_inferno[colorIndex].zyx) / 256.0, 1.0);
+#if defined(COST_RAW)
+    // counters for CostStats, read back from a float target. Alpha is the
+    // root count plus one, so that 0 is left for pixels without the floor.
+    out_color = vec4(edgeNum, costCurves, costCrossings, costRoots + 1);
+#elif defined(COST_METRIC)
+    // color mapping of the selected counter, from 0 to its full scale
+#if COST_METRIC == COST_EDGES
+    float cost = edgeNum / 256.0;
+#elif COST_METRIC == COST_CURVES
+    float cost = costCurves / 32.0;
+#elif COST_METRIC == COST_CROSSINGS
+    float cost = costCrossings / 8.0;
+#else
+    float cost = costRoots / 16.0;
+#endif
+    int colorIndex = int(clamp(cost * 256.0, 0.0, 255.0));
+    out_color = vec4(vec3(cmap_inferno[colorIndex].zyx) / 256.0, 1.0);
+#endif
+#ifdef SHOW_EDGE_SAVING
+    // edges saved by the adaptive policy, blue where it integrates more
+    int saved = fixedEdgeNum - edgeNum;
+    if (saved >= 0) {
+        out_color = vec4(vec3(cmap_inferno[clamp(4 * saved, 0, 255)].zyx) / 256.0, 1.0);
+    } else {
+        out_color = vec4(0.0, 0.0, clamp(-saved / 32.0, 0.25, 1.0), 1.0);
+    }
+#endif
+#ifdef SHOW_ROOT_ERROR
+    // red: log10 of the root error from 1e-8 (black) to 1, green: missed
+    // roots, blue: a curve crosses the horizon. Alpha is 0 there, which tells
+    // these pixels from the lights when read back by --bench-clip.
+    float logError = clamp((log(max(rootErrorMax, 1.0e-8)) / log(10.0) + 8.0) / 8.0, 0.0, 1.0);
+    out_color = vec4(logError, min(rootsMissed, 255) / 255.0, hasRoots ? 1.0 : 0.0, hasRoots ? 0.0 : 1.0);
+#endif
+#endif
 }
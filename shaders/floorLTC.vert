@@ -13,9 +13,27 @@ uniform mat4 u_mvMat;
 uniform mat4 u_mvpMat;
 uniform mat4 u_normMat;
 
+// same depth as the pre-pass in floorDepth.vert
+invariant gl_Position;
+
 void main(){
+#ifdef DEFERRED
+    // full-screen triangle, surface attributes come from the G-buffer
+    vec2 pos = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    gl_Position = vec4(2.0 * pos - 1.0, 0.0, 1.0);
+    f_normalWorld = vec3(0.0);
+    f_vertPosWorld = vec3(0.0);
+    f_texcoord = pos;
+#elif defined(LIGHTMAP_BAKE)
+    // rasterize the surface in texture space
+    gl_Position = vec4(2.0 * in_texcoord - 1.0, 0.0, 1.0);
+    f_normalWorld = (u_mMat * vec4(in_normal, 0.0)).xyz;
+    f_vertPosWorld = (u_mMat * vec4(in_position, 1.0)).xyz;
+    f_texcoord = in_texcoord;
+#else
     gl_Position = u_mvpMat * vec4(in_position, 1.0);
     f_normalWorld = (u_mMat * vec4(in_normal, 0.0)).xyz;
     f_vertPosWorld = (u_mMat * vec4(in_position, 1.0)).xyz;
     f_texcoord = vec2(in_texcoord.x, in_texcoord.y);
+#endif
 }
@@ -1,4 +1,5 @@
 #include <algorithm>
+#include <cmath>
 #include <iostream>
 
 #include <glad/gl.h>
@@ -7,6 +8,7 @@
 
 #include "bezierLight.h"
 #include "common.h"
+#include "cpuProfiler.h"
 #include "openmp.h"
 
 static constexpr int MARGIN_SIZE = 0;
@@ -36,6 +38,181 @@ float bernstein(int n, int i, double t) {
     return C(n, i) * std::pow(t, i) * std::pow(1.0 - t, n - i);
 }
 
+// Sphere around control points. A Bezier curve lies in the convex hull of
+// its control points, so this also bounds the curve (and the light shape).
+glm::vec4 boundingSphere(const glm::vec3 *points, int numPoints) {
+    glm::vec3 bmin = points[0];
+    glm::vec3 bmax = points[0];
+    for (int i = 1; i < numPoints; i++) {
+        bmin = glm::min(bmin, points[i]);
+        bmax = glm::max(bmax, points[i]);
+    }
+
+    const glm::vec3 center = 0.5f * (bmin + bmax);
+    float radius = 0.0f;
+    for (int i = 0; i < numPoints; i++) {
+        radius = std::max(radius, glm::length(points[i] - center));
+    }
+    return glm::vec4(center, radius);
+}
+
+glm::vec3 evalCubic(const glm::vec3 *cps, float t) {
+    const float s = 1.0f - t;
+    return s * s * s * cps[0] + 3.0f * s * s * t * cps[1] + 3.0f * s * t * t * cps[2] + t * t * t * cps[3];
+}
+
+// Points along a chain of cubic curves, both ends of every curve included
+std::vector<glm::vec3> sampleCurves(const std::vector<glm::vec3> &cps, int samplesPerCurve) {
+    std::vector<glm::vec3> samples;
+    for (size_t first = 0; first + NUM_CPS_IN_CURVE <= cps.size(); first += NUM_CPS_IN_CURVE) {
+        for (int j = 0; j <= samplesPerCurve; j++) {
+            samples.push_back(evalCubic(&cps[first], (float) j / (float) samplesPerCurve));
+        }
+    }
+    return samples;
+}
+
+// Symmetric Hausdorff distance between two sampled shapes
+float hausdorffDistance(const std::vector<glm::vec3> &a, const std::vector<glm::vec3> &b) {
+    auto directed = [](const std::vector<glm::vec3> &from, const std::vector<glm::vec3> &to) {
+        float maxDist2 = 0.0f;
+        for (const glm::vec3 &p : from) {
+            float minDist2 = 1.0e30f;
+            for (const glm::vec3 &q : to) {
+                minDist2 = std::min(minDist2, glm::dot(p - q, p - q));
+            }
+            maxDist2 = std::max(maxDist2, minDist2);
+        }
+        return maxDist2;
+    };
+    return std::sqrt(std::max(directed(a, b), directed(b, a)));
+}
+
+// Longest step between consecutive samples. A point of a curve lies within
+// about half of it from a sample, so it pads the sampled distance above.
+float maxSampleGap(const std::vector<glm::vec3> &samples) {
+    float maxGap = 0.0f;
+    for (size_t j = 1; j < samples.size(); j++) {
+        maxGap = std::max(maxGap, glm::length(samples[j] - samples[j - 1]));
+    }
+    return maxGap;
+}
+
+// Least-squares cubic through the samples with both end points fixed,
+// parameterized by chord length
+void fitCubic(const std::vector<glm::vec3> &samples, glm::vec3 out[NUM_CPS_IN_CURVE]) {
+    const int n = (int) samples.size();
+    std::vector<float> ts(n, 0.0f);
+    for (int j = 1; j < n; j++) {
+        ts[j] = ts[j - 1] + glm::length(samples[j] - samples[j - 1]);
+    }
+
+    out[0] = samples.front();
+    out[3] = samples.back();
+    if (ts.back() == 0.0f) {
+        out[1] = out[0];
+        out[2] = out[3];
+        return;
+    }
+
+    float a11 = 0.0f, a12 = 0.0f, a22 = 0.0f;
+    glm::vec3 r1(0.0f), r2(0.0f);
+    for (int j = 0; j < n; j++) {
+        const float t = ts[j] / ts.back();
+        const float s = 1.0f - t;
+        const float b0 = s * s * s, b1 = 3.0f * s * s * t, b2 = 3.0f * s * t * t, b3 = t * t * t;
+        const glm::vec3 r = samples[j] - b0 * out[0] - b3 * out[3];
+        a11 += b1 * b1;
+        a12 += b1 * b2;
+        a22 += b2 * b2;
+        r1 += b1 * r;
+        r2 += b2 * r;
+    }
+
+    const float det = a11 * a22 - a12 * a12;
+    if (std::abs(det) < 1.0e-12f) {
+        out[1] = glm::mix(out[0], out[3], 1.0f / 3.0f);
+        out[2] = glm::mix(out[0], out[3], 2.0f / 3.0f);
+        return;
+    }
+    out[1] = (a22 * r1 - a12 * r2) / det;
+    out[2] = (a11 * r2 - a12 * r1) / det;
+}
+
+// Every two consecutive curves replaced by one fitted curve
+std::vector<glm::vec3> mergeCurvePairs(const std::vector<glm::vec3> &cps) {
+    const int numCurves = (int) cps.size() / NUM_CPS_IN_CURVE;
+    std::vector<glm::vec3> merged;
+    for (int i = 0; i < numCurves; i += 2) {
+        const int count = std::min(2, numCurves - i);
+        const std::vector<glm::vec3> pair(cps.begin() + i * NUM_CPS_IN_CURVE,
+                                          cps.begin() + (i + count) * NUM_CPS_IN_CURVE);
+        glm::vec3 fitted[NUM_CPS_IN_CURVE];
+        fitCubic(sampleCurves(pair, 16), fitted);
+        merged.insert(merged.end(), fitted, fitted + NUM_CPS_IN_CURVE);
+    }
+    return merged;
+}
+
+// Closed polygon with vertices equally spaced along the shape, as straight curves
+std::vector<glm::vec3> fitPolygon(const std::vector<glm::vec3> &cps, int numEdges) {
+    const std::vector<glm::vec3> samples = sampleCurves(cps, 32);
+    std::vector<float> lengths(samples.size(), 0.0f);
+    for (size_t j = 1; j < samples.size(); j++) {
+        lengths[j] = lengths[j - 1] + glm::length(samples[j] - samples[j - 1]);
+    }
+
+    std::vector<glm::vec3> vertices;
+    size_t j = 0;
+    for (int k = 0; k < numEdges; k++) {
+        const float target = lengths.back() * (float) k / (float) numEdges;
+        while (j + 1 < samples.size() && lengths[j + 1] < target) {
+            j++;
+        }
+        const float segment = j + 1 < samples.size() ? lengths[j + 1] - lengths[j] : 0.0f;
+        const float u = segment > 0.0f ? (target - lengths[j]) / segment : 0.0f;
+        vertices.push_back(glm::mix(samples[j], samples[std::min(j + 1, samples.size() - 1)], u));
+    }
+
+    std::vector<glm::vec3> polygon;
+    for (int k = 0; k < numEdges; k++) {
+        const glm::vec3 &v0 = vertices[k];
+        const glm::vec3 &v1 = vertices[(k + 1) % numEdges];
+        polygon.insert(polygon.end(), { v0, glm::mix(v0, v1, 1.0f / 3.0f), glm::mix(v0, v1, 2.0f / 3.0f), v1 });
+    }
+    return polygon;
+}
+
+float distanceToSegment(const glm::vec3 &p, const glm::vec3 &a, const glm::vec3 &b) {
+    const glm::vec3 ab = b - a;
+    const float len2 = glm::dot(ab, ab);
+    const float t = len2 > 0.0f ? glm::clamp(glm::dot(p - a, ab) / len2, 0.0f, 1.0f) : 0.0f;
+    return glm::length(p - (a + t * ab));
+}
+
+// Vertices of a polygon within tolerance of the curve, the end point excluded.
+// The curve lies in the convex hull of its control points, so it is close
+// enough to the chord when the inner control points are.
+void flattenCurve(const glm::vec3 *cps, float tolerance, int depth, std::vector<glm::vec3> &vertices) {
+    if (depth == 0 || std::max(distanceToSegment(cps[1], cps[0], cps[3]),
+                               distanceToSegment(cps[2], cps[0], cps[3])) <= tolerance) {
+        vertices.push_back(cps[0]);
+        return;
+    }
+
+    // de Casteljau at t = 0.5
+    const glm::vec3 p01 = 0.5f * (cps[0] + cps[1]);
+    const glm::vec3 p12 = 0.5f * (cps[1] + cps[2]);
+    const glm::vec3 p23 = 0.5f * (cps[2] + cps[3]);
+    const glm::vec3 p012 = 0.5f * (p01 + p12);
+    const glm::vec3 p123 = 0.5f * (p12 + p23);
+    const glm::vec3 mid = 0.5f * (p012 + p123);
+    const glm::vec3 left[NUM_CPS_IN_CURVE] = { cps[0], p01, p012, mid };
+    const glm::vec3 right[NUM_CPS_IN_CURVE] = { mid, p123, p23, cps[3] };
+    flattenCurve(left, tolerance, depth - 1, vertices);
+    flattenCurve(right, tolerance, depth - 1, vertices);
+}
+
 }  // anonymous namespace
 
 void BezierLight::initialize() {
@@ -60,6 +237,8 @@ void BezierLight::initialize() {
 }
 
 void BezierLight::createCPSmodel(LightType type) {
+    CPU_PROFILE_SCOPE("createCPSmodel");
+
     // create cps in normalize model space [-1, 1]
     cpsModel.clear();
     cpsModel.shrink_to_fit();
@@ -283,6 +462,8 @@ void BezierLight::createCPSmodel(LightType type) {
 
     glBindVertexArray(0);
 
+    buildLODs();
+
     // default translation parameters
     size = glm::vec2(2.0f);
     rotAngle = 90.0f * glm::vec3(0.0f, 0.0f, 0.0f);
@@ -290,23 +471,85 @@ void BezierLight::createCPSmodel(LightType type) {
 }
 
 void BezierLight::calcCPSworld() {
+    CPU_PROFILE_SCOPE("calcCPSworld");
+
     // update transformation
     modelMat = glm::translate(translate) *
                rotateXYZ(degToRad(rotAngle)) *
                glm::scale(glm::vec3(size, 1.0f));
 
     // compute control points in world space
-    cpsWorld.resize(numPoints);
-    for (int i = 0; i < numPoints; i++) {
-        glm::vec4 p = modelMat * glm::vec4(cpsModel[i], 1.0f);
-        // Avoid numerical unstability in algebraic clipping
-        p.y = p.y > 0.0 ? p.y + 1.0e-3 : p.y - 1.0e-3;
-        cpsWorld[i] = glm::vec3(p.x, p.y, p.z);
+    auto toWorld = [&](const std::vector<glm::vec3> &model, std::vector<glm::vec3> &world) {
+        world.resize(model.size());
+        for (size_t i = 0; i < model.size(); i++) {
+            glm::vec4 p = modelMat * glm::vec4(model[i], 1.0f);
+            // Avoid numerical unstability in algebraic clipping
+            p.y = p.y > 0.0 ? p.y + 1.0e-3 : p.y - 1.0e-3;
+            world[i] = glm::vec3(p.x, p.y, p.z);
+        }
+    };
+    toWorld(cpsModel, cpsWorld);
+
+    // The model matrix scales distances by at most the larger of the sizes
+    const float maxScale = std::max(std::abs(size.x), std::abs(size.y));
+    lodCpsWorld.resize(lodCpsModel.size());
+    lodCurveSpheres.resize(lodCpsModel.size());
+    lodErrors.resize(lodCpsModel.size());
+    for (size_t level = 0; level < lodCpsModel.size(); level++) {
+        toWorld(lodCpsModel[level], lodCpsWorld[level]);
+        lodErrors[level] = lodErrorsModel[level] * maxScale;
+
+        const int numLodCurves = (int) lodCpsWorld[level].size() / NUM_CPS_IN_CURVE;
+        lodCurveSpheres[level].resize(numLodCurves);
+        for (int i = 0; i < numLodCurves; i++) {
+            lodCurveSpheres[level][i] = ::boundingSphere(&lodCpsWorld[level][i * NUM_CPS_IN_CURVE], NUM_CPS_IN_CURVE);
+        }
     }
 
     // compute barycenter of area light
     glm::vec4 p = modelMat * glm::vec4(center, 1.0f);
     center = glm::vec3(p.x, p.y, p.z);
+
+    // bounds for horizon culling
+    boundingSphere = ::boundingSphere(cpsWorld.data(), numPoints);
+    curveSpheres.resize(numCurves);
+    for (int i = 0; i < numCurves; i++) {
+        curveSpheres[i] = ::boundingSphere(&cpsWorld[i * NUM_CPS_IN_CURVE], NUM_CPS_IN_CURVE);
+    }
+
+    flattenCurves();
+}
+
+void BezierLight::flattenCurves() {
+    // the curves form a closed loop, each ending where the next one begins
+    const float tolerance = FLATTEN_TOLERANCE * boundingSphere.w;
+    polygonWorld.clear();
+    for (int i = 0; i < numCurves; i++) {
+        flattenCurve(&cpsWorld[i * NUM_CPS_IN_CURVE], tolerance, MAX_FLATTEN_DEPTH, polygonWorld);
+    }
+}
+
+void BezierLight::buildLODs() {
+    // Curves are merged in pairs while that still removes some, then the
+    // coarsest level is a polygon, which costs one edge per side.
+    lodCpsModel.clear();
+    std::vector<glm::vec3> current = cpsModel;
+    while ((int) lodCpsModel.size() < MAX_LIGHT_LODS - 2 && (int) current.size() > 2 * NUM_CPS_IN_CURVE) {
+        current = mergeCurvePairs(current);
+        lodCpsModel.push_back(current);
+    }
+    lodCpsModel.push_back(fitPolygon(cpsModel, LOD_POLYGON_EDGES));
+
+    // The distance between point samples is an estimate, not a bound, and
+    // can miss a bulge between samples. Half the largest sample gap of each
+    // shape is added, so that a level is rather used too late than too early.
+    const std::vector<glm::vec3> original = sampleCurves(cpsModel, 32);
+    lodErrorsModel.clear();
+    for (const auto &level : lodCpsModel) {
+        const std::vector<glm::vec3> samples = sampleCurves(level, 32);
+        const float margin = 0.5f * std::max(maxSampleGap(original), maxSampleGap(samples));
+        lodErrorsModel.push_back(hausdorffDistance(original, samples) + margin);
+    }
 }
 
 glm::mat4 BezierLight::rotateX(float ax) {
@@ -378,43 +621,10 @@ void BezierLight::gaussianFilter(std::vector<std::vector<float>> &kernel, int ke
     }
 }
 
-void BezierLight::createBezLightTex(const std::string &filename) {
-    // load image file
-    int channels;
-    unsigned char *bytes = stbi_load(filename.c_str(), &this->texWidth, &this->texHeight, &channels, STBI_rgb_alpha);
-
-    if (!bytes) {
-        fprintf(stderr, "Failed to load image file: %s\n", filename.c_str());
-        exit(1);
-    }
-    this->marginSize = MARGIN_SIZE;
-    this->maxLOD = int(std::log2(texWidth + 2 * marginSize));
-
-    // prepare texture storage
-    GLenum target = GL_TEXTURE_2D;
-    GLenum filter = GL_LINEAR_MIPMAP_LINEAR;
-    GLenum address = GL_CLAMP_TO_EDGE;
-
-    glGenTextures(1, &bezLightTexId);
-    glBindTexture(target, bezLightTexId);
-    glTexParameteri(target, GL_TEXTURE_MAG_FILTER, filter);
-    glTexParameteri(target, GL_TEXTURE_MIN_FILTER, filter);
-    glTexParameteri(target, GL_TEXTURE_WRAP_S, address);
-    glTexParameteri(target, GL_TEXTURE_WRAP_T, address);
-    glTexImage2D(target, 0, GL_RGBA8, this->texWidth, this->texHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
-    glGenerateMipmap(target);
+// Clear the texels outside the shape, found by their winding number
+void BezierLight::maskOutsideShape(float *Pbytes) {
+    CPU_PROFILE_SCOPE("mask");
 
-    // generate prefiltered LOD texture
-    if (texWidth != texHeight || pow(2, std::log2(texHeight)) != texHeight) {
-        Error("invalid texture size, cannot compute maxLOD");
-    }
-
-    float *Pbytes = new float[4 * texWidth * texHeight];
-    for (int i = 0; i < 4 * texWidth * texHeight; i++) {
-        Pbytes[i] = float(bytes[i]) / 255.0f;
-    }
-
-    // clip texture by bezier-curve shape and generate distance map
     for (int row = 0; row < texHeight; row++) {
         for (int col = 0; col < texWidth; col++) {
             const int texelIndex = 4 * (row * texWidth + col);
@@ -462,6 +672,48 @@ void BezierLight::createBezLightTex(const std::string &filename) {
             }
         }
     }
+}
+
+void BezierLight::createBezLightTex(const std::string &filename) {
+    CPU_PROFILE_SCOPE("createBezLightTex", filename);
+
+    // load image file
+    int channels;
+    unsigned char *bytes = stbi_load(filename.c_str(), &this->texWidth, &this->texHeight, &channels, STBI_rgb_alpha);
+
+    if (!bytes) {
+        fprintf(stderr, "Failed to load image file: %s\n", filename.c_str());
+        exit(1);
+    }
+    this->marginSize = MARGIN_SIZE;
+    this->maxLOD = int(std::log2(texWidth + 2 * marginSize));
+
+    // prepare texture storage
+    GLenum target = GL_TEXTURE_2D;
+    GLenum filter = GL_LINEAR_MIPMAP_LINEAR;
+    GLenum address = GL_CLAMP_TO_EDGE;
+
+    glGenTextures(1, &bezLightTexId);
+    glBindTexture(target, bezLightTexId);
+    glTexParameteri(target, GL_TEXTURE_MAG_FILTER, filter);
+    glTexParameteri(target, GL_TEXTURE_MIN_FILTER, filter);
+    glTexParameteri(target, GL_TEXTURE_WRAP_S, address);
+    glTexParameteri(target, GL_TEXTURE_WRAP_T, address);
+    glTexImage2D(target, 0, GL_RGBA8, this->texWidth, this->texHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glGenerateMipmap(target);
+
+    // generate prefiltered LOD texture
+    if (texWidth != texHeight || pow(2, std::log2(texHeight)) != texHeight) {
+        Error("invalid texture size, cannot compute maxLOD");
+    }
+
+    float *Pbytes = new float[4 * texWidth * texHeight];
+    for (int i = 0; i < 4 * texWidth * texHeight; i++) {
+        Pbytes[i] = float(bytes[i]) / 255.0f;
+    }
+
+    // clip texture by bezier-curve shape and generate distance map
+    maskOutsideShape(Pbytes);
 
     // Save
     for (int i = 0; i < texWidth * texHeight; i++) {
@@ -502,6 +754,9 @@ void BezierLight::createBezLightTex(const std::string &filename) {
 
     int LODfactor = 1;
     for (int LOD = 0; LOD <= maxLOD; LOD++) {
+        // LOD 0 filters the outside of the shape by its distance to the curves
+        CPU_PROFILE_SCOPE(LOD == 0 ? "distance" : "LOD", "LOD " + std::to_string(LOD));
+
         const int LODwidth = texWidth / LODfactor;
         const int LODheight = texHeight / LODfactor;
         float *Sbytes = new float[4 * LODwidth * LODheight];
@@ -695,16 +950,11 @@ void BezierLight::createBernCoeffTex() {
     glBindTexture(target, 0);
 }
 
-void BezierLight::drawBez(const Camera &camera) {
+void BezierLight::drawBez(const Camera &camera, ShaderVariants &lightShaders) {
+    programId = lightShaders.get("");
     glUseProgram(programId);
 
-    GLuint location = glGetUniformLocation(programId, "u_cpsWorld");
-    glUniform3fv(location, numPoints, glm::value_ptr(cpsWorld[0]));
-
-    location = glGetUniformLocation(programId, "u_numCurves");
-    glUniform1i(location, numCurves);
-
-    location = glGetUniformLocation(programId, "u_isTwoSided");
+    GLuint location = glGetUniformLocation(programId, "u_isTwoSided");
     glUniform1i(location, isTwoSided);
 
     location = glGetUniformLocation(programId, "u_isBezTexed");
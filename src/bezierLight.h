@@ -8,6 +8,15 @@
 static constexpr int NUM_CPS_IN_CURVE = 4;
 static constexpr int COEFF_DIV = 1024;
 
+// Levels of detail of the light shape, including the original curves
+static constexpr int MAX_LIGHT_LODS = 4;
+static constexpr int LOD_POLYGON_EDGES = 8;
+
+// Flattened contour for rough reflections: maximum distance to the curves,
+// relative to the radius of the bounding sphere, and subdivision depth
+static constexpr float FLATTEN_TOLERANCE = 0.002f;
+static constexpr int MAX_FLATTEN_DEPTH = 6;
+
 enum LightType {
     ONE = 0,
     TWO = 1,
@@ -22,20 +31,35 @@ enum LightType {
 struct BezierLight : public RenderObject {
     void initialize();
     void createCPSmodel(LightType);
+    void buildLODs();
     void calcCPSworld();
+    void flattenCurves();
     glm::vec3 bezierCurve(const int curve, const float t);
 
     void gaussianFilter(std::vector<std::vector<float>> &kernel, int kernelSize, float sigma);
+    void maskOutsideShape(float *Pbytes);
     void createBezLightTex(const std::string &filename);
 
     void compBernCoeffs();
     void createBernCoeffTex();
-    void drawBez(const Camera &camera);
+    void drawBez(const Camera &camera, ShaderVariants &lightShaders);
 
     int numPoints;
     int numCurves;
     std::vector<glm::vec3> cpsModel;
     std::vector<glm::vec3> cpsWorld;
+    glm::vec4 boundingSphere;               // center and radius in world space
+    std::vector<glm::vec4> curveSpheres;    // per curve
+
+    // Simplified shapes, from pairwise merged curves to a polygon, each with
+    // its estimated Hausdorff distance to the original shape (level 0, not
+    // stored here), see buildLODs
+    std::vector<std::vector<glm::vec3>> lodCpsModel;
+    std::vector<float> lodErrorsModel;
+    std::vector<std::vector<glm::vec3>> lodCpsWorld;
+    std::vector<std::vector<glm::vec4>> lodCurveSpheres;
+    std::vector<float> lodErrors;           // in world space
+    std::vector<glm::vec3> polygonWorld;    // vertices of the flattened contour
     std::vector<glm::vec3> samplePoints;
     std::array<glm::vec4, COEFF_DIV + 1> bernCoeffs;
 
@@ -0,0 +1,391 @@
+#include <algorithm>
+#include <cmath>
+#include <string>
+
+#include <glad/gl.h>
+
+#include "bezierLightSet.h"
+
+namespace {
+
+// Plane of a (nearly) planar light. Newell's method gives the normal of the
+// control polygon by its winding; lights emit to the opposite side.
+glm::vec4 lightPlane(const std::vector<glm::vec3> &cps) {
+    glm::vec3 normal(0.0f);
+    glm::vec3 centroid(0.0f);
+    for (size_t i = 0; i < cps.size(); i++) {
+        const glm::vec3 &p0 = cps[i];
+        const glm::vec3 &p1 = cps[(i + 1) % cps.size()];
+        normal += glm::cross(p0, p1);
+        centroid += p0 / (float) cps.size();
+    }
+
+    const float len = glm::length(normal);
+    if (len == 0.0f) {
+        // degenerate light, never rejected
+        return glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+    }
+
+    normal /= -len;  // flip to the emitting side
+    return glm::vec4(normal, -glm::dot(normal, centroid));
+}
+
+// Value of the cubic Bernstein polynomial with coefficients d at t
+double bernstein(const double d[4], double t) {
+    const double s = 1.0 - t;
+    return s * s * s * d[0] + 3.0 * s * s * t * d[1] + 3.0 * s * t * t * d[2] + t * t * t * d[3];
+}
+
+// Sign changes of a cubic Bernstein polynomial in (0, 1), in ascending order.
+// The extrema split [0, 1] into monotonic pieces, each holding at most one
+// root, which is then found by bisection.
+int bernsteinRoots(const double d[4], double ts[3]) {
+    // derivative in power basis: 3a t^2 + 2b t + c
+    const double a = -d[0] + 3.0 * d[1] - 3.0 * d[2] + d[3];
+    const double b = 3.0 * (d[0] - 2.0 * d[1] + d[2]);
+    const double c = 3.0 * (-d[0] + d[1]);
+
+    double bounds[4] = { 0.0 };
+    int numBounds = 1;
+    double extrema[2];
+    int numExtrema = 0;
+    if (std::abs(a) > 1.0e-12) {
+        const double D = b * b - 3.0 * a * c;
+        if (D > 0.0) {
+            const double sqrtD = std::sqrt(D);
+            extrema[numExtrema++] = (-b - sqrtD) / (3.0 * a);
+            extrema[numExtrema++] = (-b + sqrtD) / (3.0 * a);
+        }
+    } else if (std::abs(b) > 1.0e-12) {
+        extrema[numExtrema++] = -c / (2.0 * b);
+    }
+    std::sort(extrema, extrema + numExtrema);
+    for (int i = 0; i < numExtrema; i++) {
+        if (extrema[i] > 0.0 && extrema[i] < 1.0) {
+            bounds[numBounds++] = extrema[i];
+        }
+    }
+    bounds[numBounds++] = 1.0;
+
+    int count = 0;
+    for (int i = 0; i + 1 < numBounds; i++) {
+        double lo = bounds[i];
+        double hi = bounds[i + 1];
+        const double fLo = bernstein(d, lo);
+        if (fLo * bernstein(d, hi) >= 0.0) {
+            continue;
+        }
+        for (int iter = 0; iter < 64; iter++) {
+            const double mid = 0.5 * (lo + hi);
+            if ((bernstein(d, mid) < 0.0) == (fLo < 0.0)) {
+                lo = mid;
+            } else {
+                hi = mid;
+            }
+        }
+        ts[count++] = 0.5 * (lo + hi);
+    }
+    return count;
+}
+
+// Part [t0, t1] of a cubic Bezier curve, by de Casteljau's algorithm
+void subCurve(const glm::vec3 cps[4], float t0, float t1, glm::vec3 out[4]) {
+    // [0, t1]
+    glm::vec3 a = glm::mix(cps[0], cps[1], t1);
+    glm::vec3 b = glm::mix(cps[1], cps[2], t1);
+    glm::vec3 c = glm::mix(cps[2], cps[3], t1);
+    glm::vec3 ab = glm::mix(a, b, t1);
+    glm::vec3 bc = glm::mix(b, c, t1);
+    const glm::vec3 left[4] = { cps[0], a, ab, glm::mix(ab, bc, t1) };
+
+    // [t0 / t1, 1] of that part
+    const float s = t1 > 0.0f ? t0 / t1 : 0.0f;
+    a = glm::mix(left[0], left[1], s);
+    b = glm::mix(left[1], left[2], s);
+    c = glm::mix(left[2], left[3], s);
+    ab = glm::mix(a, b, s);
+    bc = glm::mix(b, c, s);
+    out[0] = glm::mix(ab, bc, s);
+    out[1] = bc;
+    out[2] = c;
+    out[3] = left[3];
+}
+
+// Control points lie on the chord between the end points
+bool isStraight(const glm::vec3 cps[4]) {
+    const glm::vec3 chord = cps[3] - cps[0];
+    const float len2 = glm::dot(chord, chord);
+    if (len2 == 0.0f) {
+        return false;
+    }
+    const float tol2 = 1.0e-10f * len2 * len2;
+    const glm::vec3 c1 = glm::cross(cps[1] - cps[0], chord);
+    const glm::vec3 c2 = glm::cross(cps[2] - cps[0], chord);
+    return glm::dot(c1, c1) <= tol2 && glm::dot(c2, c2) <= tol2;
+}
+
+// Degree of the polynomial a cubic curve actually is: 1 for a straight line,
+// 2 for a degree-elevated quadratic (e.g. a TrueType outline), 3 otherwise
+int curveDegree(const glm::vec3 cps[4]) {
+    if (isStraight(cps)) {
+        return 1;
+    }
+    const glm::vec3 c1 = 3.0f * (cps[1] - cps[0]);
+    const glm::vec3 c2 = 3.0f * (cps[0] - 2.0f * cps[1] + cps[2]);
+    const glm::vec3 c3 = -cps[0] + 3.0f * cps[1] - 3.0f * cps[2] + cps[3];
+    const float tol2 = 1.0e-10f * (glm::dot(c1, c1) + glm::dot(c2, c2));
+    return glm::dot(c3, c3) <= tol2 ? 2 : 3;
+}
+
+// Curve record (see CURVE_RECORD_SIZE), divScale goes to w of texel 1.
+// Lines are stored with uniform speed and lines and quadratics with exactly
+// zero higher coefficients, so the shader finds their roots in closed form.
+void pushCurve(std::vector<glm::vec4> &curves, const glm::vec3 cps[4], float divScale) {
+    const int degree = curveDegree(cps);
+    glm::vec3 p[4] = { cps[0], cps[1], cps[2], cps[3] };
+    if (degree == 1) {
+        p[1] = glm::mix(cps[0], cps[3], 1.0f / 3.0f);
+        p[2] = glm::mix(cps[0], cps[3], 2.0f / 3.0f);
+    }
+
+    curves.push_back(glm::vec4(p[0], (float) degree));
+    curves.push_back(glm::vec4(p[1], divScale));
+    curves.push_back(glm::vec4(p[2], 0.0f));
+    curves.push_back(glm::vec4(p[3], 0.0f));
+
+    // B(t) = c0 + c1 t + c2 t^2 + c3 t^3
+    curves.push_back(glm::vec4(p[0], 0.0f));
+    if (degree == 1) {
+        curves.push_back(glm::vec4(p[3] - p[0], 0.0f));
+        curves.push_back(glm::vec4(0.0f));
+    } else {
+        curves.push_back(glm::vec4(3.0f * (p[1] - p[0]), 0.0f));
+        curves.push_back(glm::vec4(3.0f * (p[0] - 2.0f * p[1] + p[2]), 0.0f));
+    }
+    curves.push_back(degree == 3 ? glm::vec4(-p[0] + 3.0f * p[1] - 3.0f * p[2] + p[3], 0.0f) : glm::vec4(0.0f));
+}
+
+void pushEdge(std::vector<glm::vec4> &contour, const glm::vec3 &v0, const glm::vec3 &v1) {
+    const glm::vec3 cps[4] = { v0, glm::mix(v0, v1, 1.0f / 3.0f), glm::mix(v0, v1, 2.0f / 3.0f), v1 };
+    pushCurve(contour, cps, 0.0f);
+}
+
+// Same contour as the horizon clipping of evaluateLTCspec in floorLTC.frag:
+// the parts of the curves above the plane, in order, where each exit point
+// is joined to the next entry point by a straight edge along the plane.
+void appendPreclippedContour(const std::vector<glm::vec3> &cps, const glm::vec4 &plane,
+                             std::vector<glm::vec4> &contour) {
+    bool hasBegin = false;
+    glm::vec3 vBegin(0.0f);
+    bool hasEnd = false;
+    glm::vec3 vEnd(0.0f);
+
+    for (size_t first = 0; first + NUM_CPS_IN_CURVE <= cps.size(); first += NUM_CPS_IN_CURVE) {
+        const glm::vec3 *bez = &cps[first];
+        double d[4];
+        for (int i = 0; i < 4; i++) {
+            d[i] = glm::dot(glm::vec3(plane), bez[i]) + plane.w;
+        }
+
+        double roots[3];
+        const int numRoots = bernsteinRoots(d, roots);
+        if (numRoots == 0) {
+            // wholly above or below
+            if (bernstein(d, 0.5) > 0.0 || (d[0] >= 0.0 && d[1] >= 0.0 && d[2] >= 0.0 && d[3] >= 0.0)) {
+                pushCurve(contour, bez, 1.0f);
+            }
+            continue;
+        }
+
+        double ts[5] = { 0.0 };
+        std::copy(roots, roots + numRoots, ts + 1);
+        ts[numRoots + 1] = 1.0;
+        for (int i = 0; i <= numRoots; i++) {
+            if (bernstein(d, 0.5 * (ts[i] + ts[i + 1])) <= 0.0) {
+                continue;
+            }
+
+            glm::vec3 part[4];
+            subCurve(bez, (float) ts[i], (float) ts[i + 1], part);
+
+            // entering above the plane
+            if (i > 0) {
+                if (hasEnd) {
+                    pushEdge(contour, vEnd, part[0]);
+                    hasEnd = false;
+                } else {
+                    vBegin = part[0];
+                    hasBegin = true;
+                }
+            }
+
+            pushCurve(contour, part, 0.5f);
+
+            // leaving it
+            if (i < numRoots) {
+                vEnd = part[3];
+                hasEnd = true;
+            }
+        }
+    }
+
+    if (hasBegin && hasEnd) {
+        pushEdge(contour, vEnd, vBegin);
+    }
+}
+
+}  // anonymous namespace
+
+void BezierLightSet::initialize() {
+    lights.clear();
+    cpsWorld.clear();
+    curves.clear();
+    records.clear();
+    lightTexIds.clear();
+    isAnyTextured = false;
+
+    cpsBufferId = 0;
+    cpsTexId = 0;
+    recordBufferId = 0;
+    recordTexId = 0;
+}
+
+void BezierLightSet::upload(const glm::vec4 &receiverPlane) {
+    cpsWorld.clear();
+    curves.clear();
+    records.clear();
+    lightTexIds.clear();
+    isAnyTextured = false;
+
+    // contours are stored after the records and the curve spheres
+    int numCurvesTotal = 0;
+    for (const auto &light : lights) {
+        numCurvesTotal += light.numCurves;
+        for (const auto &level : light.lodCpsWorld) {
+            numCurvesTotal += (int) level.size() / NUM_CPS_IN_CURVE;
+        }
+    }
+    const int contourBase = (int) lights.size() * LIGHT_RECORD_SIZE + numCurvesTotal;
+    std::vector<glm::vec4> curveSpheres;
+    std::vector<glm::vec4> contours;
+    std::vector<glm::vec4> polygons;
+
+    for (const auto &light : lights) {
+        // the original shape and its simplified levels, one after another
+        const int numLevels = 1 + (int) light.lodCpsWorld.size();
+        glm::vec4 levels[MAX_LIGHT_LODS];
+        glm::vec4 lodErrors(0.0f);
+        for (int level = 0; level < numLevels; level++) {
+            const auto &cps = level == 0 ? light.cpsWorld : light.lodCpsWorld[level - 1];
+            const auto &spheres = level == 0 ? light.curveSpheres : light.lodCurveSpheres[level - 1];
+
+            const int firstCurve = (int) cpsWorld.size() / NUM_CPS_IN_CURVE;
+            const int numLevelCurves = (int) cps.size() / NUM_CPS_IN_CURVE;
+            cpsWorld.insert(cpsWorld.end(), cps.begin(), cps.end());
+            for (int curve = 0; curve < numLevelCurves; curve++) {
+                pushCurve(curves, &cps[curve * NUM_CPS_IN_CURVE], 1.0f);
+            }
+            curveSpheres.insert(curveSpheres.end(), spheres.begin(), spheres.end());
+
+            const int firstTexel = contourBase + (int) contours.size();
+            appendPreclippedContour(cps, receiverPlane, contours);
+            const int numSegments = (contourBase + (int) contours.size() - firstTexel) / CURVE_RECORD_SIZE;
+
+            levels[level] = glm::vec4((float) firstCurve, (float) numLevelCurves, (float) firstTexel, (float) numSegments);
+            lodErrors[level] = level == 0 ? 0.0f : light.lodErrors[level - 1];
+        }
+        for (int level = numLevels; level < MAX_LIGHT_LODS; level++) {
+            levels[level] = levels[numLevels - 1];
+            lodErrors[level] = lodErrors[numLevels - 1];
+        }
+
+        // lights sharing a texture share its slot
+        int flags = light.isTwoSided ? LIGHT_TWO_SIDED : 0;
+        int texSlot = 0;
+        if (light.isBezTexed) {
+            auto it = std::find(lightTexIds.begin(), lightTexIds.end(), light.bezLightTexId);
+            texSlot = (int) (it - lightTexIds.begin());
+            if (it == lightTexIds.end() && lightTexIds.size() < MAX_LIGHT_TEXTURES) {
+                lightTexIds.push_back(light.bezLightTexId);
+            }
+
+            // lights beyond the available slots are drawn without texture
+            if (texSlot < MAX_LIGHT_TEXTURES) {
+                flags |= LIGHT_TEXTURED;
+                isAnyTextured = true;
+            }
+        }
+
+        records.push_back(glm::vec4(levels[0].x, levels[0].y, (float) flags, (float) texSlot));
+        records.push_back(glm::vec4(light.Le, (float) numLevels));
+        // the light quad spans [-1, 1]^2 in model space
+        const glm::vec4 corner = light.modelMat * glm::vec4(-1.0f, -1.0f, 0.0f, 1.0f);
+        records.push_back(corner);
+        records.push_back(light.modelMat * glm::vec4(1.0f, -1.0f, 0.0f, 1.0f) - corner);
+        records.push_back(light.modelMat * glm::vec4(-1.0f, 1.0f, 0.0f, 1.0f) - corner);
+        records.push_back(glm::vec4(light.texWidth, light.texHeight, light.marginSize, light.maxLOD));
+        records.push_back(lightPlane(light.cpsWorld));
+        records.push_back(light.boundingSphere);
+        records.insert(records.end(), levels, levels + MAX_LIGHT_LODS);
+        records.push_back(lodErrors);
+
+        // offset from the first polygon vertex, fixed up below
+        records.push_back(glm::vec4((float) polygons.size(), (float) light.polygonWorld.size(), 0.0f, 0.0f));
+        for (const glm::vec3 &vertex : light.polygonWorld) {
+            polygons.push_back(glm::vec4(vertex, 1.0f));
+        }
+    }
+
+    const int polygonBase = contourBase + (int) contours.size();
+    for (size_t i = 0; i < lights.size(); i++) {
+        records[i * LIGHT_RECORD_SIZE + 9 + MAX_LIGHT_LODS].x += (float) polygonBase;
+    }
+
+    records.insert(records.end(), curveSpheres.begin(), curveSpheres.end());
+    records.insert(records.end(), contours.begin(), contours.end());
+    records.insert(records.end(), polygons.begin(), polygons.end());
+
+    if (cpsBufferId == 0) {
+        glGenBuffers(1, &cpsBufferId);
+        glGenTextures(1, &cpsTexId);
+        glGenBuffers(1, &recordBufferId);
+        glGenTextures(1, &recordTexId);
+    }
+
+    // Reallocate every time, as the number of curves changes with the scene
+    glBindBuffer(GL_TEXTURE_BUFFER, cpsBufferId);
+    glBufferData(GL_TEXTURE_BUFFER, sizeof(glm::vec4) * curves.size(), curves.data(), GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, recordBufferId);
+    glBufferData(GL_TEXTURE_BUFFER, sizeof(glm::vec4) * records.size(), records.data(), GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+    glBindTexture(GL_TEXTURE_BUFFER, cpsTexId);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, cpsBufferId);
+    glBindTexture(GL_TEXTURE_BUFFER, recordTexId);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, recordBufferId);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+}
+
+void BezierLightSet::bindTextures(GLuint programId, int firstUnit) const {
+    GLuint location = glGetUniformLocation(programId, "u_numLights");
+    glUniform1i(location, (int) lights.size());
+
+    location = glGetUniformLocation(programId, "u_cpsBuffer");
+    glActiveTexture(GL_TEXTURE0 + firstUnit);
+    glBindTexture(GL_TEXTURE_BUFFER, cpsTexId);
+    glUniform1i(location, firstUnit);
+
+    location = glGetUniformLocation(programId, "u_lightBuffer");
+    glActiveTexture(GL_TEXTURE0 + firstUnit + 1);
+    glBindTexture(GL_TEXTURE_BUFFER, recordTexId);
+    glUniform1i(location, firstUnit + 1);
+
+    for (int i = 0; i < MAX_LIGHT_TEXTURES; i++) {
+        const int unit = firstUnit + 2 + i;
+        const std::string name = "u_bezLightTex[" + std::to_string(i) + "]";
+        location = glGetUniformLocation(programId, name.c_str());
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(GL_TEXTURE_2D, i < (int) lightTexIds.size() ? lightTexIds[i] : 0);
+        glUniform1i(location, unit);
+    }
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <vector>
+
+#include "bezierLight.h"
+
+// Layout of the per-curve record in floorLTC.frag (texels of RGBA32F)
+//   0-3: control points in world space, w of texel 0 is the degree of the
+//        curve (1 for a straight line, 2 for a quadratic, 3 for a cubic)
+//   4-7: power-basis coefficients of t^0 to t^3, zero above the degree
+// Everything a fragment needs besides its own transform is computed here once
+// per frame, so the shader does not convert bases or test for lines. Every
+// curve keeps the cubic layout, so records stay indexed by curve.
+static constexpr int CURVE_RECORD_SIZE = 8;
+
+// Layout of the per-light record in floorLTC.frag (texels of RGBA32F)
+//   0: first curve, number of curves, flags, texture slot
+//   1: Le, number of shape levels (see BezierLight::buildLODs)
+//   2: corner (-1, -1) of the light quad in world space
+//   3: edge of the quad from (-1, -1) to (1, -1)
+//   4: edge of the quad from (-1, -1) to (-1, 1)
+//   5: texture width, height, margin size, max LOD
+//   6: plane of the light (normal points to the emitting side)
+//   7: bounding sphere
+//   8-11: per shape level, first curve, number of curves, first texel and
+//         number of segments of the pre-clipped contour (unused levels
+//         repeat the last one)
+//   12: estimated Hausdorff distance of each shape level to the original shape
+//   13: first texel and number of vertices of the flattened contour
+// The records are followed by the bounding sphere of every curve, indexed by
+// global curve index, then by the pre-clipped contours and the vertices of
+// the flattened contours (see BezierLight::flattenCurves).
+//
+// The pre-clipped contour is the part of the light above the receiver plane,
+// closed along the plane. It is the same for every point on that plane, so
+// the diffuse term of a planar receiver needs no clipping per pixel. Each
+// segment is a curve record; w of texel 1 is 1 for a whole curve, 0.5 for a
+// clipped part and 0 for a straight edge.
+static constexpr int LIGHT_RECORD_SIZE = 10 + MAX_LIGHT_LODS;
+static constexpr int MAX_LIGHT_TEXTURES = 4;
+static constexpr int LIGHT_TWO_SIDED = 1;
+static constexpr int LIGHT_TEXTURED = 2;
+
+struct BezierLightSet {
+    void initialize();
+    void upload(const glm::vec4 &receiverPlane);
+    void bindTextures(GLuint programId, int firstUnit) const;
+    int numTextureUnits() const { return 2 + MAX_LIGHT_TEXTURES; }
+
+    std::vector<BezierLight> lights;
+    ShaderVariants shaders;  // stencil program shared by every light, see drawBez
+
+    std::vector<glm::vec3> cpsWorld;
+    std::vector<glm::vec4> curves;
+    std::vector<glm::vec4> records;
+    std::vector<GLuint> lightTexIds;
+    bool isAnyTextured;
+
+    GLuint cpsBufferId;
+    GLuint cpsTexId;
+    GLuint recordBufferId;
+    GLuint recordTexId;
+};
@@ -4,13 +4,17 @@
 
 static const int WIN_WIDTH = 1024;
 static const int WIN_HEIGHT = 1024;
-static const char *WIN_TITLE = "Bezier Area Light";
+static const char *const WIN_TITLE = "Bezier Area Light";
 
 static const std::string PLANE_OBJ = "data/plane.obj";
 static const std::string SMALLPLANE_OBJ = "data/small_plane.obj";
 
+static const std::string SHADER_DIR = "shaders";
 static const std::string FLOORLTC_SHADER = "shaders/floorLTC";
+static const std::string FLOORGBUFFER_SHADER = "shaders/floorGBuffer";
+static const std::string FLOORDEPTH_SHADER = "shaders/floorDepth";
 static const std::string BEZLIGHT_SHADER = "shaders/bezierLight";
+static const std::string SHADER_CACHE_DIR = "shader_cache";
 
 static const std::string GRADATION_PNG = "data/gradation_squares.png";
 static const std::string CAVITY_PNG = "data/clipped_cavity_small.png";  // for debugging only, apply to square (QUAD) light
@@ -0,0 +1,131 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include <glad/gl.h>
+
+#include "costStats.h"
+
+void CostStats::initialize() {
+    width = 0;
+    height = 0;
+
+    fboId = 0;
+    colorTexId = 0;
+    depthStencilRboId = 0;
+
+    numPixels = 0;
+    for (int metric = 0; metric < NUM_COST_METRICS; metric++) {
+        totals[metric] = 0.0;
+        maxima[metric] = 0;
+        binWidths[metric] = 1;
+        std::fill(histograms[metric], histograms[metric] + COST_HISTOGRAM_BINS, 0);
+    }
+}
+
+void CostStats::resize(int width, int height) {
+    if (this->width == width && this->height == height) {
+        return;
+    }
+    this->width = width;
+    this->height = height;
+
+    if (fboId == 0) {
+        glGenFramebuffers(1, &fboId);
+        glGenTextures(1, &colorTexId);
+        glGenRenderbuffers(1, &depthStencilRboId);
+    }
+
+    GLint prevFboId;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &prevFboId);
+    glBindFramebuffer(GL_FRAMEBUFFER, fboId);
+
+    // counters are exact in 32-bit floats
+    glBindTexture(GL_TEXTURE_2D, colorTexId);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, width, height, 0, GL_RGBA, GL_FLOAT, NULL);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTexId, 0);
+
+    // the lights are drawn first, so that the floor behind them is not counted
+    glBindRenderbuffer(GL_RENDERBUFFER, depthStencilRboId);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthStencilRboId);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        fprintf(stderr, "Cost statistics buffer is incomplete: %dx%d\n", width, height);
+        exit(1);
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, prevFboId);
+}
+
+void CostStats::reduce() {
+    std::vector<float> texels(width * height * 4);
+    GLint prevFboId;
+    glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &prevFboId);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, fboId);
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_FLOAT, (void *) texels.data());
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, prevFboId);
+
+    // edges, curves, crossings, roots + 1 (0 where there is no floor)
+    std::vector<int> values;
+    values.reserve(texels.size());
+    for (int i = 0; i < width * height; i++) {
+        const float *texel = &texels[i * 4];
+        if (texel[3] == 0.0f) {
+            continue;
+        }
+        for (int metric = 0; metric < NUM_COST_METRICS; metric++) {
+            values.push_back((int) std::lround(texel[metric]) - (metric == 3 ? 1 : 0));
+        }
+    }
+
+    numPixels = (int) values.size() / NUM_COST_METRICS;
+    for (int metric = 0; metric < NUM_COST_METRICS; metric++) {
+        totals[metric] = 0.0;
+        maxima[metric] = 0;
+        for (int i = 0; i < numPixels; i++) {
+            const int value = values[i * NUM_COST_METRICS + metric];
+            totals[metric] += value;
+            maxima[metric] = std::max(maxima[metric], value);
+        }
+
+        // integer bins covering 0 to the maximum
+        binWidths[metric] = maxima[metric] / COST_HISTOGRAM_BINS + 1;
+        std::fill(histograms[metric], histograms[metric] + COST_HISTOGRAM_BINS, 0);
+        for (int i = 0; i < numPixels; i++) {
+            histograms[metric][values[i * NUM_COST_METRICS + metric] / binWidths[metric]]++;
+        }
+    }
+}
+
+// One row per metric: totals over the floor pixels, then the histogram. Rows
+// start with a label, so that several results can share a file.
+void CostStats::writeCSVHeader(FILE *fp) {
+    fprintf(fp, "label,metric,pixels,total,mean,max,bin width");
+    for (int bin = 0; bin < COST_HISTOGRAM_BINS; bin++) {
+        fprintf(fp, ",bin %d", bin);
+    }
+    fprintf(fp, "\n");
+}
+
+void CostStats::writeCSV(FILE *fp, const char *label) const {
+    for (int metric = 0; metric < NUM_COST_METRICS; metric++) {
+        fprintf(fp, "%s,%s,%d,%.0f,%.4f,%d,%d", label, metricName(metric), numPixels, totals[metric],
+                numPixels > 0 ? totals[metric] / numPixels : 0.0, maxima[metric], binWidths[metric]);
+        for (int bin = 0; bin < COST_HISTOGRAM_BINS; bin++) {
+            fprintf(fp, ",%d", histograms[metric][bin]);
+        }
+        fprintf(fp, "\n");
+    }
+}
+
+const char *CostStats::metricName(int metric) {
+    static const char *names[NUM_COST_METRICS] = { "edges", "curves", "crossings", "roots" };
+    return names[metric];
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdio>
+
+#define GLFW_INCLUDE_GLU
+#include <GLFW/glfw3.h>
+
+// ----------------------------------------------------------------------------
+// Frame-wide statistics of the per-pixel cost of the floor LTC pass
+// The COST_RAW permutation of floorLTC.frag writes the counters of every
+// floor pixel to the float target here, which is read back and reduced on the
+// CPU. GLSL 4.10 (macOS) has no atomic counters or storage buffers to do it
+// on the GPU, and the statistics are only taken on request.
+// ----------------------------------------------------------------------------
+
+// in the order of the RGBA channels and of CostMetric from COST_EDGES
+static constexpr int NUM_COST_METRICS = 4;
+static constexpr int COST_HISTOGRAM_BINS = 32;
+
+struct CostStats {
+    void initialize();
+    void resize(int width, int height);
+    void reduce();
+    void writeCSV(FILE *fp, const char *label) const;
+
+    static void writeCSVHeader(FILE *fp);
+    static const char *metricName(int metric);
+
+    int width;
+    int height;
+
+    GLuint fboId;
+    GLuint colorTexId;
+    GLuint depthStencilRboId;
+
+    // results of the last reduce()
+    int numPixels;  // pixels of the floor
+    double totals[NUM_COST_METRICS];
+    int maxima[NUM_COST_METRICS];
+    int binWidths[NUM_COST_METRICS];  // histogram bin i counts values from i * width
+    int histograms[NUM_COST_METRICS][COST_HISTOGRAM_BINS];
+};
@@ -0,0 +1,148 @@
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include "cpuProfiler.h"
+
+namespace {
+
+struct CpuProfileEvent {
+    const char *name;
+    std::string detail;
+    double startUs;
+    double durationUs;
+    int threadId;
+};
+
+std::atomic<bool> isProfiling(false);
+std::mutex eventMutex;
+std::vector<CpuProfileEvent> events;
+std::map<int, std::string> threadNames;
+int numDropped = 0;
+
+std::atomic<int> nextThreadId(1);
+thread_local int threadId = 0;
+
+const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+
+double nowUs() {
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+// Small ids in order of first use, which read better in the viewer
+int currentThreadId() {
+    if (threadId == 0) {
+        threadId = nextThreadId++;
+    }
+    return threadId;
+}
+
+void writeJSONString(FILE *fp, const std::string &str) {
+    fputc('"', fp);
+    for (char ch : str) {
+        if (ch == '"' || ch == '\\') {
+            fputc('\\', fp);
+            fputc(ch, fp);
+        } else if ((unsigned char) ch < 0x20) {
+            fprintf(fp, "\\u%04x", ch);
+        } else {
+            fputc(ch, fp);
+        }
+    }
+    fputc('"', fp);
+}
+
+}  // anonymous namespace
+
+void setCpuProfiling(bool enabled) {
+    isProfiling = enabled;
+}
+
+bool isCpuProfilingEnabled() {
+    return isProfiling;
+}
+
+void clearCpuProfile() {
+    std::lock_guard<std::mutex> lock(eventMutex);
+    events.clear();
+    numDropped = 0;
+}
+
+int numCpuProfileEvents() {
+    std::lock_guard<std::mutex> lock(eventMutex);
+    return (int) events.size();
+}
+
+bool saveCpuProfile(const std::string &filename) {
+    FILE *fp = fopen(filename.c_str(), "w");
+    if (fp == NULL) {
+        fprintf(stderr, "Failed to open file: %s\n", filename.c_str());
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(eventMutex);
+    fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    bool isFirst = true;
+    for (const auto &thread : threadNames) {
+        fprintf(fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":",
+                isFirst ? "" : ",\n", thread.first);
+        writeJSONString(fp, thread.second);
+        fprintf(fp, "}}");
+        isFirst = false;
+    }
+    for (const CpuProfileEvent &event : events) {
+        fprintf(fp, "%s{\"name\":", isFirst ? "" : ",\n");
+        writeJSONString(fp, event.name);
+        fprintf(fp, ",\"cat\":\"cpu\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%d",
+                event.startUs, event.durationUs, event.threadId);
+        if (!event.detail.empty()) {
+            fprintf(fp, ",\"args\":{\"detail\":");
+            writeJSONString(fp, event.detail);
+            fprintf(fp, "}");
+        }
+        fprintf(fp, "}");
+        isFirst = false;
+    }
+    fprintf(fp, "\n]}\n");
+    fclose(fp);
+
+    printf("CPU profile saved: %s (%d events", filename.c_str(), (int) events.size());
+    if (numDropped > 0) {
+        printf(", %d dropped over %d", numDropped, MAX_CPU_PROFILE_EVENTS);
+    }
+    printf(")\n");
+    return true;
+}
+
+void setCpuProfileThreadName(const std::string &name) {
+    const int id = currentThreadId();
+    std::lock_guard<std::mutex> lock(eventMutex);
+    threadNames[id] = name;
+}
+
+CpuProfileScope::CpuProfileScope(const char *name, const std::string &detail) :
+    name(name), detail(), startUs(0.0), isRecording(isProfiling) {
+    if (isRecording) {
+        this->detail = detail;
+        startUs = nowUs();
+    }
+}
+
+CpuProfileScope::~CpuProfileScope() {
+    // a scope open when profiling was turned off is still completed
+    if (!isRecording) {
+        return;
+    }
+
+    const double endUs = nowUs();
+    const int id = currentThreadId();
+    std::lock_guard<std::mutex> lock(eventMutex);
+    if ((int) events.size() >= MAX_CPU_PROFILE_EVENTS) {
+        numDropped++;
+        return;
+    }
+    events.push_back({ name, detail, startUs, endUs - startUs, id });
+}
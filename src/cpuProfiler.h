@@ -0,0 +1,37 @@
+#pragma once
+
+#include <string>
+
+// ----------------------------------------------------------------------------
+// Scoped CPU timers written as Chrome trace events
+// A CPU_PROFILE_SCOPE records one complete event ("ph": "X") from its
+// construction to the end of the enclosing block, on the thread it runs on.
+// Nothing is recorded while profiling is off, so the scopes can stay in the
+// code. The saved file opens in chrome://tracing or ui.perfetto.dev.
+// ----------------------------------------------------------------------------
+
+static constexpr int MAX_CPU_PROFILE_EVENTS = 1 << 20;
+
+void setCpuProfiling(bool enabled);
+bool isCpuProfilingEnabled();
+void clearCpuProfile();
+int numCpuProfileEvents();
+bool saveCpuProfile(const std::string &filename);
+
+// Name shown for the calling thread in the trace
+void setCpuProfileThreadName(const std::string &name);
+
+struct CpuProfileScope {
+    // detail is shown as an argument of the event, e.g., a file name
+    explicit CpuProfileScope(const char *name, const std::string &detail = "");
+    ~CpuProfileScope();
+
+    const char *name;
+    std::string detail;
+    double startUs;
+    bool isRecording;
+};
+
+#define CPU_PROFILE_CONCAT_(a, b) a##b
+#define CPU_PROFILE_CONCAT(a, b) CPU_PROFILE_CONCAT_(a, b)
+#define CPU_PROFILE_SCOPE(...) CpuProfileScope CPU_PROFILE_CONCAT(cpuProfileScope, __LINE__)(__VA_ARGS__)
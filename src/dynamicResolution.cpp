@@ -0,0 +1,55 @@
+#include <algorithm>
+#include <cmath>
+
+#include <glad/gl.h>
+
+#include "dynamicResolution.h"
+#include "gpuTimer.h"
+
+// weight of the latest result in the running average
+static constexpr double AVERAGE_WEIGHT = 0.25;
+
+// the scale only grows when the time is this far below the budget, so that
+// it does not flip between two steps around the budget
+static constexpr double GROW_HEADROOM = 0.85;
+
+void DynamicResolution::initialize() {
+    isEnabled = false;
+    budgetMs = 16.6;
+    scale = 1.0f;
+
+    averageMs = 0.0;
+    framesSinceChange = 0;
+}
+
+void DynamicResolution::update(double gpuMs) {
+    if (!isEnabled) {
+        scale = 1.0f;
+        averageMs = 0.0;
+        return;
+    }
+
+    // the results of the first NUM_TIMER_QUERIES frames were measured at the
+    // previous scale, and there are none where timer queries are unsupported
+    framesSinceChange++;
+    if (framesSinceChange <= NUM_TIMER_QUERIES || gpuMs <= 0.0) {
+        return;
+    }
+    averageMs = averageMs > 0.0 ? averageMs + AVERAGE_WEIGHT * (gpuMs - averageMs) : gpuMs;
+
+    const float ideal = scale * (float) std::sqrt(budgetMs / averageMs);
+    const float target =
+        std::min(std::max(std::floor(ideal / RENDER_SCALE_STEP) * RENDER_SCALE_STEP, MIN_RENDER_SCALE), 1.0f);
+    const bool isShrink = target < scale;
+    const bool isGrow = target > scale && averageMs < GROW_HEADROOM * budgetMs;
+    if (std::abs(target - scale) >= 0.5f * RENDER_SCALE_STEP && (isShrink || isGrow)) {
+        scale = target;
+        averageMs = 0.0;
+        framesSinceChange = 0;
+    }
+}
+
+int DynamicResolution::scaled(int size) const {
+    // full size as soon as it is turned off, before update resets the scale
+    return std::max(1, (int) std::lround(size * (isEnabled ? scale : 1.0f)));
+}
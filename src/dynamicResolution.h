@@ -0,0 +1,25 @@
+#pragma once
+
+// ----------------------------------------------------------------------------
+// Render scale that keeps the GPU time of the scene within a budget
+// The LTC passes dominate the frame and cost about the same per pixel, so
+// their time goes with the square of the scale. The scale is corrected from
+// the recent timer results towards the budget, and only after the queries of
+// the previous scale have come back (see GpuTimer).
+// ----------------------------------------------------------------------------
+
+static constexpr float MIN_RENDER_SCALE = 0.5f;
+static constexpr float RENDER_SCALE_STEP = 0.05f;
+
+struct DynamicResolution {
+    void initialize();
+    void update(double gpuMs);
+    int scaled(int size) const;
+
+    bool isEnabled;
+    double budgetMs;
+    float scale;
+
+    double averageMs;       // recent GPU time at the current scale, 0 if none yet
+    int framesSinceChange;
+};
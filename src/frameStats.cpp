@@ -0,0 +1,134 @@
+#include <algorithm>
+#include <cstdio>
+
+#include "frameStats.h"
+
+namespace {
+
+bool hasSuffix(const std::string &str, const std::string &suffix) {
+    return str.size() >= suffix.size() && str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+void writeJSONSummary(FILE *fp, const char *name, const RollingStats &times) {
+    fprintf(fp, "\"%s\":{\"frames\":%d,\"mean\":%.4f,\"p50\":%.4f,\"p95\":%.4f,\"p99\":%.4f,\"max\":%.4f}", name,
+            times.count(), times.mean(), times.percentile(50.0), times.percentile(95.0), times.percentile(99.0),
+            times.max());
+}
+
+}  // anonymous namespace
+
+void FrameStats::initialize(int capacity) {
+    frames.assign(capacity, FrameTimes());
+    numFrames = 0;
+    clear();
+}
+
+void FrameStats::clear() {
+    firstFrame = numFrames;
+    cpuMs.initialize((int) frames.size());
+    gpuMs.initialize((int) frames.size());
+}
+
+void FrameStats::add(double cpuMs, int numGpuPasses, bool isGpuTimed) {
+    FrameTimes &times = frames[numFrames % frames.size()];
+    times.cpuMs = cpuMs;
+    times.gpuMs = 0.0;
+    times.numPending = numGpuPasses;
+    times.isGpuTimed = isGpuTimed;
+    numFrames++;
+
+    this->cpuMs.add(cpuMs);
+    if (times.numPending == 0 && times.isGpuTimed) {
+        gpuMs.add(0.0);
+    }
+}
+
+void FrameStats::addGpuResult(int frame, double gpuMs) {
+    // results of frames out of the ring or from before a clear are dropped
+    const int numKept = std::min(numFrames - firstFrame, (int) frames.size());
+    if (frame < numFrames - numKept || frame >= numFrames) {
+        return;
+    }
+
+    FrameTimes &times = frames[frame % frames.size()];
+    if (times.numPending <= 0) {
+        return;
+    }
+    times.gpuMs += gpuMs;
+    times.numPending--;
+    if (times.numPending == 0 && times.isGpuTimed) {
+        this->gpuMs.add(times.gpuMs);
+    }
+}
+
+float FrameStats::histogramMaxMs() const {
+    return (float) std::max(cpuMs.max(), gpuMs.max());
+}
+
+void FrameStats::histogram(const RollingStats &times, float bins[FRAME_HISTOGRAM_BINS]) const {
+    std::fill(bins, bins + FRAME_HISTOGRAM_BINS, 0.0f);
+    const float maxMs = histogramMaxMs();
+    if (maxMs <= 0.0f) {
+        return;
+    }
+    for (int i = 0; i < times.count(); i++) {
+        const int bin = (int) (times.sample(i) / maxMs * FRAME_HISTOGRAM_BINS);
+        bins[std::min(bin, FRAME_HISTOGRAM_BINS - 1)] += 1.0f;
+    }
+}
+
+// GPU times still pending or incomplete are written empty (null in JSON)
+bool FrameStats::save(const std::string &filename) const {
+    FILE *fp = fopen(filename.c_str(), "w");
+    if (fp == NULL) {
+        fprintf(stderr, "Failed to open file: %s\n", filename.c_str());
+        return false;
+    }
+
+    const int numKept = std::min(numFrames - firstFrame, (int) frames.size());
+    const bool isJSON = hasSuffix(filename, ".json");
+    if (isJSON) {
+        fprintf(fp, "{\"summary\":{");
+        writeJSONSummary(fp, "cpu_ms", cpuMs);
+        fprintf(fp, ",");
+        writeJSONSummary(fp, "gpu_ms", gpuMs);
+        fprintf(fp, "},\n\"samples\":[\n");
+    } else {
+        fprintf(fp, "frame,cpu ms,gpu ms\n");
+    }
+
+    for (int frame = numFrames - numKept; frame < numFrames; frame++) {
+        const FrameTimes &times = frames[frame % frames.size()];
+        char gpuText[32] = "";
+        if (times.numPending == 0 && times.isGpuTimed) {
+            sprintf(gpuText, "%.4f", times.gpuMs);
+        }
+
+        if (isJSON) {
+            fprintf(fp, "%s{\"frame\":%d,\"cpu_ms\":%.4f,\"gpu_ms\":%s}", frame == numFrames - numKept ? "" : ",\n",
+                    frame, times.cpuMs, gpuText[0] != '\0' ? gpuText : "null");
+        } else {
+            fprintf(fp, "%d,%.4f,%s\n", frame, times.cpuMs, gpuText);
+        }
+    }
+
+    if (isJSON) {
+        fprintf(fp, "\n]}\n");
+    }
+    fclose(fp);
+
+    printf("Frame times saved: %s (%d frames)\n", filename.c_str(), numKept);
+    return true;
+}
+
+void FrameStats::printSummary() const {
+    printf("Frame times (ms):\n");
+    printf("%-4s %7s %8s %8s %8s %8s %8s\n", "", "frames", "mean", "p50", "p95", "p99", "max");
+    const RollingStats *series[] = { &cpuMs, &gpuMs };
+    const char *names[] = { "CPU", "GPU" };
+    for (int i = 0; i < 2; i++) {
+        printf("%-4s %7d %8.3f %8.3f %8.3f %8.3f %8.3f\n", names[i], series[i]->count(), series[i]->mean(),
+               series[i]->percentile(50.0), series[i]->percentile(95.0), series[i]->percentile(99.0),
+               series[i]->max());
+    }
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "rollingStats.h"
+
+// ----------------------------------------------------------------------------
+// CPU and GPU time of every frame over the last minute or so
+// A mean over many frames hides the single slow frames after a scene switch,
+// so the times are kept per frame for percentiles, a histogram and a dump.
+// The GPU time of a frame is the sum of the pass timers begun in it. Their
+// results come back a few frames later and are added to that frame; a frame
+// is left out of the GPU statistics until all of them are in, and for good
+// if one of its passes went untimed (see GpuTimer).
+// ----------------------------------------------------------------------------
+
+static constexpr int FRAME_STATS_SIZE = 3600;
+static constexpr int FRAME_HISTOGRAM_BINS = 32;
+
+struct FrameTimes {
+    double cpuMs;
+    double gpuMs;     // sum of the results so far
+    int numPending;   // pass results still to come
+    bool isGpuTimed;  // false if a pass was not timed
+};
+
+struct FrameStats {
+    void initialize(int capacity = FRAME_STATS_SIZE);
+    void clear();  // frame numbers keep counting, as results may be in flight
+
+    // Frame numbers follow numFrames, see setGpuTimerFrame
+    void add(double cpuMs, int numGpuPasses, bool isGpuTimed);
+    void addGpuResult(int frame, double gpuMs);
+
+    // Bins from 0 to the largest time of either series, so that CPU and GPU
+    // histograms share a scale
+    float histogramMaxMs() const;
+    void histogram(const RollingStats &times, float bins[FRAME_HISTOGRAM_BINS]) const;
+
+    // JSON if the file name ends with .json, otherwise CSV
+    bool save(const std::string &filename) const;
+    void printSummary() const;
+
+    std::vector<FrameTimes> frames;  // ring indexed by frame number
+    int numFrames;                   // frames added so far
+    int firstFrame;                  // oldest frame since the last clear
+
+    // statistics of the frames in order, GPU ones once complete
+    RollingStats cpuMs;
+    RollingStats gpuMs;
+};
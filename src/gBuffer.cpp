@@ -0,0 +1,155 @@
+#include <cstdio>
+#include <cstdlib>
+
+#include <glad/gl.h>
+
+#include "gBuffer.h"
+
+namespace {
+
+const GLenum colorFormats[NUM_GBUFFER_TARGETS] = { GL_RGBA32F, GL_RGBA16F, GL_RGBA16F, GL_RGBA8 };
+const char *uniformNames[NUM_GBUFFER_TARGETS] = { "u_gPosition", "u_gNormal", "u_gDiffuse", "u_gSpecular" };
+
+void createTexture(GLuint texId, GLenum internalFormat, int width, int height) {
+    glBindTexture(GL_TEXTURE_2D, texId);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, GL_RGBA, GL_FLOAT, NULL);
+}
+
+}  // anonymous namespace
+
+void GBuffer::initialize() {
+    width = 0;
+    height = 0;
+
+    fboId = 0;
+    for (int i = 0; i < NUM_GBUFFER_TARGETS; i++) {
+        colorTexIds[i] = 0;
+    }
+    depthRboId = 0;
+}
+
+void GBuffer::resize(int width, int height) {
+    if (this->width == width && this->height == height) {
+        return;
+    }
+    this->width = width;
+    this->height = height;
+
+    if (fboId == 0) {
+        glGenFramebuffers(1, &fboId);
+        glGenTextures(NUM_GBUFFER_TARGETS, colorTexIds);
+        glGenRenderbuffers(1, &depthRboId);
+    }
+
+    GLint prevFboId;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &prevFboId);
+    glBindFramebuffer(GL_FRAMEBUFFER, fboId);
+
+    GLenum drawBuffers[NUM_GBUFFER_TARGETS];
+    for (int i = 0; i < NUM_GBUFFER_TARGETS; i++) {
+        createTexture(colorTexIds[i], colorFormats[i], width, height);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, GL_TEXTURE_2D, colorTexIds[i], 0);
+        drawBuffers[i] = GL_COLOR_ATTACHMENT0 + i;
+    }
+    glDrawBuffers(NUM_GBUFFER_TARGETS, drawBuffers);
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    // depth is only tested here, the lighting pass reads it from the position target
+    glBindRenderbuffer(GL_RENDERBUFFER, depthRboId);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthRboId);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        fprintf(stderr, "G-buffer is incomplete: %dx%d\n", width, height);
+        exit(1);
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, prevFboId);
+}
+
+void GBuffer::clear() {
+    const GLfloat emptyPosition[] = { 0.0f, 0.0f, 0.0f, 1.0f };
+    const GLfloat zero[] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    const GLfloat farDepth = 1.0f;
+    glClearBufferfv(GL_COLOR, 0, emptyPosition);
+    for (int i = 1; i < NUM_GBUFFER_TARGETS; i++) {
+        glClearBufferfv(GL_COLOR, i, zero);
+    }
+    glClearBufferfv(GL_DEPTH, 0, &farDepth);
+}
+
+void GBuffer::bindTextures(GLuint programId, int firstUnit) const {
+    for (int i = 0; i < NUM_GBUFFER_TARGETS; i++) {
+        GLuint location = glGetUniformLocation(programId, uniformNames[i]);
+        glActiveTexture(GL_TEXTURE0 + firstUnit + i);
+        glBindTexture(GL_TEXTURE_2D, colorTexIds[i]);
+        glUniform1i(location, firstUnit + i);
+    }
+}
+
+void LowResBuffer::initialize() {
+    width = 0;
+    height = 0;
+
+    fboId = 0;
+    diffuseTexId = 0;
+    specularTexId = 0;
+}
+
+void LowResBuffer::resize(int width, int height) {
+    if (this->width == width && this->height == height) {
+        return;
+    }
+    this->width = width;
+    this->height = height;
+
+    if (fboId == 0) {
+        glGenFramebuffers(1, &fboId);
+        glGenTextures(1, &diffuseTexId);
+        glGenTextures(1, &specularTexId);
+    }
+
+    GLint prevFboId;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &prevFboId);
+    glBindFramebuffer(GL_FRAMEBUFFER, fboId);
+
+    createTexture(diffuseTexId, GL_RGBA16F, width, height);
+    createTexture(specularTexId, GL_RGBA16F, width, height);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, diffuseTexId, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, specularTexId, 0);
+
+    const GLenum drawBuffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+    glDrawBuffers(2, drawBuffers);
+
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        fprintf(stderr, "Low-res lighting buffer is incomplete: %dx%d\n", width, height);
+        exit(1);
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, prevFboId);
+}
+
+void LowResBuffer::clear() {
+    const GLfloat zero[] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    glClearBufferfv(GL_COLOR, 0, zero);
+    glClearBufferfv(GL_COLOR, 1, zero);
+}
+
+void LowResBuffer::bindTextures(GLuint programId, int firstUnit) const {
+    GLuint location = glGetUniformLocation(programId, "u_lowResDiff");
+    glActiveTexture(GL_TEXTURE0 + firstUnit);
+    glBindTexture(GL_TEXTURE_2D, diffuseTexId);
+    glUniform1i(location, firstUnit);
+
+    location = glGetUniformLocation(programId, "u_lowResSpec");
+    glActiveTexture(GL_TEXTURE0 + firstUnit + 1);
+    glBindTexture(GL_TEXTURE_2D, specularTexId);
+    glUniform1i(location, firstUnit + 1);
+}
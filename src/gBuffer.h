@@ -0,0 +1,51 @@
+#pragma once
+
+#define GLFW_INCLUDE_GLU
+#include <GLFW/glfw3.h>
+
+// ----------------------------------------------------------------------------
+// G-buffer for deferred shading of the floor
+// Attachments are written by floorGBuffer.frag and read back with texelFetch
+// by the DEFERRED permutation of floorLTC.frag:
+//   0: world position, window depth (RGBA32F, depth is 1 where empty)
+//   1: world normal, roughness (RGBA16F)
+//   2: diffuse albedo, or albedo times baked radiance with LIGHTMAP (RGBA16F)
+//   3: specular albedo (RGBA8)
+// ----------------------------------------------------------------------------
+
+static constexpr int NUM_GBUFFER_TARGETS = 4;
+
+struct GBuffer {
+    void initialize();
+    void resize(int width, int height);
+    void clear();
+    void bindTextures(GLuint programId, int firstUnit) const;
+
+    int width;
+    int height;
+
+    GLuint fboId;
+    GLuint colorTexIds[NUM_GBUFFER_TARGETS];
+    GLuint depthRboId;
+};
+
+// ----------------------------------------------------------------------------
+// Reduced-resolution lighting, written by the LOWRES_PASS permutation of
+// floorLTC.frag and upsampled by the LOWRES_DIFFUSE one:
+//   0: diffuse radiance (RGBA16F)
+//   1: specular radiance, 1 where evaluated (RGBA16F)
+// ----------------------------------------------------------------------------
+
+struct LowResBuffer {
+    void initialize();
+    void resize(int width, int height);
+    void clear();
+    void bindTextures(GLuint programId, int firstUnit) const;
+
+    int width;
+    int height;
+
+    GLuint fboId;
+    GLuint diffuseTexId;
+    GLuint specularTexId;
+};
@@ -0,0 +1,96 @@
+#include <glad/gl.h>
+
+#include "gpuTimer.h"
+
+namespace {
+
+int currentFrame = 0;
+
+}  // anonymous namespace
+
+void setGpuTimerFrame(int frame) {
+    currentFrame = frame;
+}
+
+void GpuTimer::initialize() {
+    elapsedMs = 0.0;
+    history.initialize();
+    results.clear();
+    lastFrame = -1;
+    numBegun = 0;
+    numSkipped = 0;
+    for (int i = 0; i < NUM_TIMER_QUERIES; i++) {
+        queryIds[i] = 0;
+        queryFrames[i] = -1;
+        isPending[i] = false;
+    }
+    current = 0;
+    isRunning = false;
+}
+
+void GpuTimer::begin() {
+    if (queryIds[0] == 0) {
+        glGenQueries(NUM_TIMER_QUERIES, queryIds);
+    }
+
+    if (lastFrame != currentFrame) {
+        lastFrame = currentFrame;
+        numBegun = 0;
+        numSkipped = 0;
+    }
+    numBegun++;
+
+    // collect the query issued NUM_TIMER_QUERIES frames ago before reusing it
+    if (isPending[current]) {
+        GLint isAvailable = GL_FALSE;
+        glGetQueryObjectiv(queryIds[current], GL_QUERY_RESULT_AVAILABLE, &isAvailable);
+        if (isAvailable == GL_FALSE) {
+            numSkipped++;
+            return;
+        }
+        collect(current);
+    }
+
+    glBeginQuery(GL_TIME_ELAPSED, queryIds[current]);
+    queryFrames[current] = currentFrame;
+    isRunning = true;
+}
+
+void GpuTimer::end() {
+    if (!isRunning) {
+        return;
+    }
+    glEndQuery(GL_TIME_ELAPSED);
+    isPending[current] = true;
+    current = (current + 1) % NUM_TIMER_QUERIES;
+    isRunning = false;
+}
+
+void GpuTimer::poll() {
+    // oldest first, starting from the query begin will reuse next
+    for (int i = 0; i < NUM_TIMER_QUERIES; i++) {
+        const int query = (current + i) % NUM_TIMER_QUERIES;
+        if (!isPending[query]) {
+            continue;
+        }
+        GLint isAvailable = GL_FALSE;
+        glGetQueryObjectiv(queryIds[query], GL_QUERY_RESULT_AVAILABLE, &isAvailable);
+        if (isAvailable == GL_FALSE) {
+            continue;
+        }
+        collect(query);
+    }
+}
+
+void GpuTimer::collect(int query) {
+    GLuint64 elapsedNs = 0;
+    glGetQueryObjectui64v(queryIds[query], GL_QUERY_RESULT, &elapsedNs);
+    elapsedMs = elapsedNs * 1.0e-6;
+    history.add(elapsedMs);
+    isPending[query] = false;
+
+    if ((int) results.size() >= MAX_TIMER_RESULTS) {
+        results.erase(results.begin());
+    }
+    results.push_back({ queryFrames[query], elapsedMs });
+}
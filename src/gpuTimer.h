@@ -0,0 +1,53 @@
+#pragma once
+
+#include <vector>
+
+#define GLFW_INCLUDE_GLU
+#include <GLFW/glfw3.h>
+
+#include "rollingStats.h"
+
+// ----------------------------------------------------------------------------
+// GPU time of a pass with GL_TIME_ELAPSED queries
+// Queries are used round robin and read back a few frames later, when the GPU
+// has long finished them, so timing does not stall the pipeline. If a result
+// is still not available, the pass goes untimed that frame rather than wait
+// for it. Only one timer can run at a time.
+// ----------------------------------------------------------------------------
+
+static constexpr int NUM_TIMER_QUERIES = 4;
+static constexpr int MAX_TIMER_RESULTS = 64;
+
+// A result with the frame its query was begun in (see setGpuTimerFrame)
+struct GpuTimerResult {
+    int frame;
+    double ms;
+};
+
+// Frame number that queries begun from now on are tagged with
+void setGpuTimerFrame(int frame);
+
+struct GpuTimer {
+    void initialize();
+    void begin();
+    void end();
+    void poll();  // collect every finished query without beginning one
+    void collect(int query);
+
+    double elapsedMs;     // latest available result
+    RollingStats history; // recent results, for the timing overlay
+
+    // Results not taken yet, in the order they came back (the oldest are
+    // dropped past MAX_TIMER_RESULTS), and the calls of begin in the latest
+    // frame that began one, with those skipped for a query still in flight
+    std::vector<GpuTimerResult> results;
+    int lastFrame;
+    int numBegun;
+    int numSkipped;
+
+    GLuint queryIds[NUM_TIMER_QUERIES];
+    int queryFrames[NUM_TIMER_QUERIES];
+    bool isPending[NUM_TIMER_QUERIES];
+    int current;
+    bool isRunning;
+};
@@ -0,0 +1,204 @@
+#include <algorithm>
+#include <cmath>
+
+#include <glad/gl.h>
+
+#include "common.h"
+#include "lightCulling.h"
+
+namespace {
+
+// Probability mass of the GGX lobe left outside the cone used for binning
+const float LOBE_TAIL = 1.0e-3f;
+
+float angleBetween(const glm::vec3 &a, const glm::vec3 &b) {
+    const float c = glm::dot(glm::normalize(a), glm::normalize(b));
+    return std::acos(std::max(-1.0f, std::min(c, 1.0f)));
+}
+
+// Half angle of the cone around the mirror direction holding all but
+// LOBE_TAIL of the GGX distribution. For GGX, the fraction of half vectors
+// within angle t of the normal is tan^2(t) / (alpha^2 + tan^2(t)).
+float lobeHalfAngle(float alpha) {
+    const float tanHalf = alpha * std::sqrt((1.0f - LOBE_TAIL) / LOBE_TAIL);
+    return std::min(2.0f * std::atan(tanHalf), (float) Pi);
+}
+
+}  // anonymous namespace
+
+void LightCulling::initialize() {
+    numTilesX = 0;
+    numTilesY = 0;
+    cutoff = 1.0e-4f;
+
+    tileHeaders.clear();
+    tileLights.clear();
+    avgLightsPerTile = 0.0f;
+    avgSpecLightsPerTile = 0.0f;
+
+    headerBufferId = 0;
+    headerTexId = 0;
+    listBufferId = 0;
+    listTexId = 0;
+}
+
+void LightCulling::update(const Camera &camera, const BezierLightSet &bezLights, const glm::vec4 &receiverPlane,
+                          float maxAlpha, int width, int height) {
+    numTilesX = (width + LIGHT_TILE_SIZE - 1) / LIGHT_TILE_SIZE;
+    numTilesY = (height + LIGHT_TILE_SIZE - 1) / LIGHT_TILE_SIZE;
+
+    const glm::vec3 planeN = glm::vec3(receiverPlane);
+    const float planeD = receiverPlane.w;
+    const glm::mat4 invViewProj = glm::inverse(camera.projMat * camera.viewMat);
+    const glm::vec3 eye = camera.cameraPos;
+
+    // specular reflections seen from the camera are direct views from its mirror image
+    const glm::vec3 mirrorEye = eye - 2.0f * (glm::dot(planeN, eye) + planeD) * planeN;
+    const float lobeAngle = lobeHalfAngle(std::max(0.01f, std::min(maxAlpha, 1.0f)));
+
+    // lights entirely below the receiver never reach it
+    const int numLights = (int) bezLights.lights.size();
+    std::vector<bool> isAboveHorizon(numLights);
+    for (int i = 0; i < numLights; i++) {
+        const glm::vec4 &sphere = bezLights.lights[i].boundingSphere;
+        isAboveHorizon[i] = glm::dot(planeN, glm::vec3(sphere)) + planeD > -sphere.w;
+    }
+
+    tileHeaders.resize(numTilesX * numTilesY);
+    tileLights.clear();
+    int numSpecEntries = 0;
+    for (int ty = 0; ty < numTilesY; ty++) {
+        for (int tx = 0; tx < numTilesX; tx++) {
+            // receiver patch seen through the tile (gl_FragCoord has its origin at the bottom left)
+            glm::vec3 corners[4];
+            bool isBounded = true;
+            for (int k = 0; k < 4; k++) {
+                const float px = (float) std::min((tx + (k & 1)) * LIGHT_TILE_SIZE, width);
+                const float py = (float) std::min((ty + (k >> 1)) * LIGHT_TILE_SIZE, height);
+                glm::vec4 farPoint = invViewProj * glm::vec4(2.0f * px / width - 1.0f, 2.0f * py / height - 1.0f, 1.0f, 1.0f);
+                const glm::vec3 dir = glm::vec3(farPoint) / farPoint.w - eye;
+
+                const float denom = glm::dot(planeN, dir);
+                const float t = denom != 0.0f ? -(glm::dot(planeN, eye) + planeD) / denom : -1.0f;
+                if (t <= 0.0f) {
+                    // the tile reaches the horizon, so the patch is unbounded
+                    isBounded = false;
+                    break;
+                }
+                corners[k] = eye + t * dir;
+            }
+
+            glm::vec3 patchCenter(0.0f);
+            float patchRadius = 0.0f;
+            glm::vec3 mirrorAxis(0.0f);
+            float mirrorSpread = 0.0f;
+            if (isBounded) {
+                patchCenter = 0.25f * (corners[0] + corners[1] + corners[2] + corners[3]);
+                mirrorAxis = patchCenter - mirrorEye;
+                for (int k = 0; k < 4; k++) {
+                    patchRadius = std::max(patchRadius, glm::length(corners[k] - patchCenter));
+                    mirrorSpread = std::max(mirrorSpread, angleBetween(mirrorAxis, corners[k] - mirrorEye));
+                }
+            }
+
+            glm::uvec2 &header = tileHeaders[ty * numTilesX + tx];
+            header.x = (uint32_t) tileLights.size();
+            for (int i = 0; i < numLights; i++) {
+                if (!isAboveHorizon[i]) {
+                    continue;
+                }
+
+                if (!isBounded) {
+                    tileLights.push_back(i | TILE_LIGHT_SPECULAR);
+                    numSpecEntries++;
+                    continue;
+                }
+
+                const BezierLight &light = bezLights.lights[i];
+                const glm::vec3 sphereCenter = glm::vec3(light.boundingSphere);
+                const float sphereRadius = light.boundingSphere.w;
+
+                // one-sided lights facing away from the whole patch
+                if (!light.isTwoSided) {
+                    const glm::vec4 &plane = bezLights.records[i * LIGHT_RECORD_SIZE + 6];
+                    bool isFacing = false;
+                    for (int k = 0; k < 4; k++) {
+                        isFacing = isFacing || glm::dot(glm::vec3(plane), corners[k]) + plane.w > 0.0f;
+                    }
+                    if (!isFacing) {
+                        continue;
+                    }
+                }
+
+                // Specular: the light must overlap the cone of mirror directions
+                // over the patch, widened by the lobe and the size of both.
+                const glm::vec3 toLight = sphereCenter - patchCenter;
+                bool isSpecular = glm::length(toLight) <= patchRadius + sphereRadius;
+                if (!isSpecular) {
+                    const float spread = std::asin(std::min(1.0f, (patchRadius + sphereRadius) / glm::length(toLight)));
+                    isSpecular = angleBetween(mirrorAxis, toLight) <= mirrorSpread + lobeAngle + spread;
+                }
+
+                // Range, for diffuse only: the cosine-weighted solid angle of
+                // the light is at most that of a disk of the bounding radius
+                // facing the patch. A sharp lobe reflecting the light returns
+                // close to its full radiance at any distance, so lights the
+                // lobe may reach are kept.
+                if (!isSpecular) {
+                    const float dist = std::max(glm::length(toLight) - patchRadius, sphereRadius);
+                    const float maxLe = std::max(light.Le.x, std::max(light.Le.y, light.Le.z));
+                    if (maxLe * sphereRadius * sphereRadius / (dist * dist) < cutoff) {
+                        continue;
+                    }
+                }
+
+                tileLights.push_back(i | (isSpecular ? TILE_LIGHT_SPECULAR : 0u));
+                numSpecEntries += isSpecular ? 1 : 0;
+            }
+            header.y = (uint32_t) tileLights.size() - header.x;
+        }
+    }
+
+    const float numTiles = (float) tileHeaders.size();
+    avgLightsPerTile = tileLights.size() / numTiles;
+    avgSpecLightsPerTile = numSpecEntries / numTiles;
+
+    // texture buffers cannot be empty
+    if (tileLights.empty()) {
+        tileLights.push_back(0u);
+    }
+
+    if (headerBufferId == 0) {
+        glGenBuffers(1, &headerBufferId);
+        glGenTextures(1, &headerTexId);
+        glGenBuffers(1, &listBufferId);
+        glGenTextures(1, &listTexId);
+    }
+
+    glBindBuffer(GL_TEXTURE_BUFFER, headerBufferId);
+    glBufferData(GL_TEXTURE_BUFFER, sizeof(glm::uvec2) * tileHeaders.size(), tileHeaders.data(), GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, listBufferId);
+    glBufferData(GL_TEXTURE_BUFFER, sizeof(uint32_t) * tileLights.size(), tileLights.data(), GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+    glBindTexture(GL_TEXTURE_BUFFER, headerTexId);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RG32UI, headerBufferId);
+    glBindTexture(GL_TEXTURE_BUFFER, listTexId);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_R32UI, listBufferId);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+}
+
+void LightCulling::bindTextures(GLuint programId, int firstUnit) const {
+    GLuint location = glGetUniformLocation(programId, "u_numTilesX");
+    glUniform1i(location, numTilesX);
+
+    location = glGetUniformLocation(programId, "u_tileHeaders");
+    glActiveTexture(GL_TEXTURE0 + firstUnit);
+    glBindTexture(GL_TEXTURE_BUFFER, headerTexId);
+    glUniform1i(location, firstUnit);
+
+    location = glGetUniformLocation(programId, "u_tileLights");
+    glActiveTexture(GL_TEXTURE0 + firstUnit + 1);
+    glBindTexture(GL_TEXTURE_BUFFER, listTexId);
+    glUniform1i(location, firstUnit + 1);
+}
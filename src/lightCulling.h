@@ -0,0 +1,41 @@
+#pragma once
+
+#include <vector>
+
+#include "bezierLightSet.h"
+#include "render.h"
+
+// ----------------------------------------------------------------------------
+// Tiled light culling for the floor pass
+// Each screen tile gets the list of lights that can reach the part of the
+// receiver plane seen through it. Binning runs on the CPU (GL 4.1 has no
+// compute shaders) and the lists are read in floorLTC.frag from texture buffers.
+// ----------------------------------------------------------------------------
+
+static constexpr int LIGHT_TILE_SIZE = 16;
+
+// set on a tile list entry when the specular lobe may reach the light
+static constexpr uint32_t TILE_LIGHT_SPECULAR = 0x80000000u;
+
+struct LightCulling {
+    void initialize();
+    void update(const Camera &camera, const BezierLightSet &bezLights, const glm::vec4 &receiverPlane,
+                float maxAlpha, int width, int height);
+    void bindTextures(GLuint programId, int firstUnit) const;
+
+    int numTilesX;
+    int numTilesY;
+    float cutoff;  // radiance below this is ignored when binning diffuse lighting
+
+    std::vector<glm::uvec2> tileHeaders;  // offset and count in tileLights
+    std::vector<uint32_t> tileLights;     // light index | TILE_LIGHT_SPECULAR
+
+    // statistics of the latest update
+    float avgLightsPerTile;
+    float avgSpecLightsPerTile;
+
+    GLuint headerBufferId;
+    GLuint headerTexId;
+    GLuint listBufferId;
+    GLuint listTexId;
+};
@@ -0,0 +1,52 @@
+#include <cstdio>
+#include <cstdlib>
+
+#include <glad/gl.h>
+
+#include "lightmap.h"
+
+void Lightmap::initialize() {
+    fboId = 0;
+    texId = 0;
+    bakedState.clear();
+}
+
+void Lightmap::create() {
+    if (fboId != 0) {
+        return;
+    }
+    glGenFramebuffers(1, &fboId);
+    glGenTextures(1, &texId);
+
+    GLint prevFboId;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &prevFboId);
+    glBindFramebuffer(GL_FRAMEBUFFER, fboId);
+
+    // radiance is not clamped to [0, 1] before the albedo is applied
+    glBindTexture(GL_TEXTURE_2D, texId);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, LIGHTMAP_SIZE, LIGHTMAP_SIZE, 0, GL_RGBA, GL_FLOAT, NULL);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texId, 0);
+
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        fprintf(stderr, "Lightmap is incomplete: %dx%d\n", LIGHTMAP_SIZE, LIGHTMAP_SIZE);
+        exit(1);
+    }
+
+    // no light until the first bake
+    const GLfloat zero[] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    glClearBufferfv(GL_COLOR, 0, zero);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, prevFboId);
+}
+
+void Lightmap::bindTexture(GLuint programId, int unit) const {
+    GLuint location = glGetUniformLocation(programId, "u_lightmap");
+    glActiveTexture(GL_TEXTURE0 + unit);
+    glBindTexture(GL_TEXTURE_2D, texId);
+    glUniform1i(location, unit);
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <vector>
+
+#define GLFW_INCLUDE_GLU
+#include <GLFW/glfw3.h>
+
+// ----------------------------------------------------------------------------
+// Diffuse radiance of the floor baked in texture space
+// Written by the LIGHTMAP_BAKE permutation of floorLTC.frag and sampled with
+// the mesh UVs by the LIGHTMAP one. Diffuse does not depend on the view, so
+// it is only rebaked when the lights or the floor move (see bakedState).
+// ----------------------------------------------------------------------------
+
+static constexpr int LIGHTMAP_SIZE = 1024;
+
+struct Lightmap {
+    void initialize();
+    void create();
+    void bindTexture(GLuint programId, int unit) const;
+
+    GLuint fboId;
+    GLuint texId;
+
+    // state of the lights and the receiver at the last bake
+    std::vector<float> bakedState;
+};
@@ -1,3 +1,6 @@
+#include <algorithm>
+#include <sstream>
+
 #include <glad/gl.h>
 #include <stb_image.h>
 
@@ -12,6 +15,52 @@ void LtcSurface::initialize() {
 
     isRoughTexed = false;
     roughnessTexId = -1;
+    maxRoughTexAlpha = 1.0f;
+
+    clipMethod = CLIP_ALGEBRAIC;
+    costMetric = COST_NONE;
+    isCostRaw = false;
+    isShowRootError = false;
+
+    isAdaptiveSubdiv = true;
+    isShowEdgeSaving = false;
+
+    gaussOrder = 0;
+    referenceChords = 0;
+
+    isPolygonFallback = true;
+    polygonAlpha = 0.6f;
+
+    isPreclipped = true;
+
+    isLightLOD = true;
+
+    lightCulling.initialize();
+    isTiledCulling = true;
+
+    gBuffer.initialize();
+    screenVaoId = 0;
+    isDeferred = false;
+
+    lowResBuffer.initialize();
+    lowResScale = 1;
+    isLowResSpec = false;
+    lowResSpecAlpha = 0.5f;
+
+    lightmap.initialize();
+    isLightmap = false;
+
+    isDepthPrepass = false;
+
+    prepassTimer.initialize();
+    ltcTimer.initialize();
+}
+
+glm::vec4 LtcSurface::receiverPlane() const {
+    // floor plane (y = 0 in model space)
+    const glm::vec3 normal = glm::normalize(glm::vec3(modelMat * glm::vec4(0.0f, 1.0f, 0.0f, 0.0f)));
+    const glm::vec3 origin = glm::vec3(modelMat * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+    return glm::vec4(normal, -glm::dot(normal, origin));
 }
 
 void LtcSurface::createLTCmatTex() {
@@ -108,13 +157,106 @@ void LtcSurface::createRoughnessTex(const std::string &filename) {
         exit(1);
     }
 
+    // the roughest texel bounds the specular lobe in light culling
+    int maxValue = 0;
+    for (int i = 0; i < texWidth * texHeight; i++) {
+        maxValue = std::max(maxValue, (int) bytes[4 * i]);
+    }
+    maxRoughTexAlpha = maxValue / 255.0f;
+
     glTexImage2D(target, 0, GL_RGBA32F, texWidth, texHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, bytes);
     glGenerateMipmap(target);
 
     glBindTexture(target, 0);
 }
 
-void LtcSurface::drawSurface(const Camera &camera, const BezierLight bezLight) {
+std::string LtcSurface::variantDefines(const BezierLightSet &bezLights, LtcPass pass) const {
+    std::ostringstream defines;
+    defines << "#define BEZ_TEXTURED " << (bezLights.isAnyTextured ? "true" : "false") << "\n";
+    defines << "#define ROUGH_TEXTURED " << (isRoughTexed ? "true" : "false") << "\n";
+    defines << "#define CLIP_METHOD " << (int) clipMethod << "\n";
+    if (isCostRaw && pass == LTC_PASS_SHADE) {
+        defines << "#define COST_METRIC " << (int) COST_EDGES << "\n";
+        defines << "#define COST_RAW\n";
+    } else if (costMetric != COST_NONE) {
+        defines << "#define COST_METRIC " << (int) costMetric << "\n";
+        if (costMetric == COST_EDGES && isAdaptiveSubdiv && isShowEdgeSaving && gaussOrder == 0 && referenceChords == 0) {
+            defines << "#define SHOW_EDGE_SAVING\n";
+        }
+    }
+    if (isAdaptiveSubdiv) {
+        defines << "#define ADAPTIVE_SUBDIV\n";
+    }
+    if (referenceChords > 0) {
+        defines << "#define UNIFORM_CHORDS " << referenceChords << "\n";
+    } else if (gaussOrder > 0) {
+        defines << "#define GAUSS_ORDER " << gaussOrder << "\n";
+    }
+    if (isPreclipped && clipMethod != CLIP_POLYGON) {
+        defines << "#define PRECLIPPED_DIFFUSE\n";
+    }
+    if (isLightLOD) {
+        defines << "#define LIGHT_LOD\n";
+    }
+    if (isShowRootError && !isCostRaw && clipMethod != CLIP_POLYGON && pass == LTC_PASS_SHADE) {
+        defines << "#define SHOW_ROOT_ERROR\n";
+    }
+    if (isPolygonFallback && clipMethod != CLIP_POLYGON) {
+        defines << "#define POLYGON_FALLBACK\n";
+    }
+    if (pass == LTC_PASS_LIGHTMAP_BAKE) {
+        // texture space, screen tiles and the G-buffer do not apply
+        defines << "#define LIGHTMAP_BAKE\n";
+        return defines.str();
+    }
+    if (isTiledCulling) {
+        defines << "#define TILED_CULLING\n";
+    }
+    if (isLightmap) {
+        defines << "#define LIGHTMAP\n";
+    }
+    if (isDeferred) {
+        defines << "#define DEFERRED\n";
+        if (pass == LTC_PASS_LOWRES) {
+            defines << "#define LOWRES_PASS\n";
+        } else if (lowResScale > 1 && !isLightmap) {
+            defines << "#define LOWRES_DIFFUSE\n";
+        }
+    }
+    return defines.str();
+}
+
+void LtcSurface::useShaderVariant(const BezierLightSet &bezLights) {
+    // Specializing feature flags at compile time lets the driver drop
+    // unused code paths and registers.
+    // Until a variant has been linked in the background, the generic program
+    // (defines left to runtime uniforms) is used instead.
+    programId = shaders.get(variantDefines(bezLights));
+}
+
+void LtcSurface::drawDepth(const Camera &camera) {
+    programId = depthShaders.get("");
+    glUseProgram(programId);
+
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    draw(camera, glm::vec3(0.0f), glm::vec3(0.0f));
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+}
+
+void LtcSurface::drawGBuffer(const Camera &camera, int width, int height) {
+    gBuffer.resize(width, height);
+
+    GLint prevFboId;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &prevFboId);
+    glBindFramebuffer(GL_FRAMEBUFFER, gBuffer.fboId);
+    gBuffer.clear();
+
+    std::ostringstream defines;
+    defines << "#define ROUGH_TEXTURED " << (isRoughTexed ? "true" : "false") << "\n";
+    if (isLightmap) {
+        defines << "#define LIGHTMAP\n";
+    }
+    programId = gBufferShaders.get(defines.str());
     glUseProgram(programId);
 
     GLuint location = glGetUniformLocation(programId, "u_alpha");
@@ -123,26 +265,189 @@ void LtcSurface::drawSurface(const Camera &camera, const BezierLight bezLight) {
     location = glGetUniformLocation(programId, "u_isRoughTexed");
     glUniform1i(location, isRoughTexed);
 
-    location = glGetUniformLocation(programId, "u_cameraPos");
-    glUniform3fv(location, 1, glm::value_ptr(camera.cameraPos));
+    if (isRoughTexed) {
+        location = glGetUniformLocation(programId, "u_roughnessTex");
+        glActiveTexture(GL_TEXTURE2);
+        glBindTexture(GL_TEXTURE_2D, roughnessTexId);
+        glUniform1i(location, 2);
+    }
 
-    location = glGetUniformLocation(programId, "u_cpsWorld");
-    glUniform3fv(location, bezLight.numPoints, glm::value_ptr(bezLight.cpsWorld[0]));
+    if (isLightmap) {
+        lightmap.bindTexture(programId, 3);
+    }
 
-    location = glGetUniformLocation(programId, "u_numCurves");
-    glUniform1i(location, bezLight.numCurves);
+    // lights are not used by the G-buffer pass
+    draw(camera, glm::vec3(0.0f), glm::vec3(0.0f));
 
-    location = glGetUniformLocation(programId, "u_lightCenter");
-    glUniform3fv(location, 1, glm::value_ptr(bezLight.center));
+    glBindFramebuffer(GL_FRAMEBUFFER, prevFboId);
+}
 
-    location = glGetUniformLocation(programId, "u_isLightMove");
-    glUniform1i(location, bezLight.isMove);
+void LtcSurface::bakeLightmap(const Camera &camera, const BezierLightSet &bezLights) {
+    // world-space control points and records cover every change made by
+    // calcCPSworld, the floor transform and the shader defines of the bake
+    // variant the rest
+    std::vector<float> state;
+    state.reserve(3 * bezLights.cpsWorld.size() + 4 * bezLights.records.size() + 22);
+    for (const glm::vec3 &cp : bezLights.cpsWorld) {
+        state.insert(state.end(), { cp.x, cp.y, cp.z });
+    }
+    for (const glm::vec4 &texel : bezLights.records) {
+        state.insert(state.end(), { texel.x, texel.y, texel.z, texel.w });
+    }
+    const float *mMat = glm::value_ptr(modelMat);
+    state.insert(state.end(), mMat, mMat + 16);
+    state.push_back((float) clipMethod);
+    state.push_back((float) isLightLOD);
+    state.push_back((float) isAdaptiveSubdiv);
+    state.push_back((float) gaussOrder);
+    state.push_back((float) referenceChords);
+    state.push_back((float) isPreclipped);
+
+    lightmap.create();
+    if (state == lightmap.bakedState) {
+        return;
+    }
 
-    location = glGetUniformLocation(programId, "u_isTwoSided");
-    glUniform1i(location, bezLight.isTwoSided);
+    // the generic program does not rasterize in texture space, so the bake
+    // waits for its variant (the scene stays dirty while shaders are pending)
+    const GLuint bakeProgramId = shaders.get(variantDefines(bezLights, LTC_PASS_LIGHTMAP_BAKE));
+    if (bakeProgramId == shaders.get("")) {
+        return;
+    }
+
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    GLint prevFboId;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &prevFboId);
+    glBindFramebuffer(GL_FRAMEBUFFER, lightmap.fboId);
+    glViewport(0, 0, LIGHTMAP_SIZE, LIGHTMAP_SIZE);
+    glDisable(GL_DEPTH_TEST);
+    const GLfloat zero[] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    glClearBufferfv(GL_COLOR, 0, zero);
+
+    programId = bakeProgramId;
+    glUseProgram(programId);
+    bindLightingUniforms(camera, bezLights, LTC_PASS_LIGHTMAP_BAKE);
+    const BezierLight &bezLight = bezLights.lights[0];
+    draw(camera, bezLight.center, bezLight.Le);
+
+    glEnable(GL_DEPTH_TEST);
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    glBindFramebuffer(GL_FRAMEBUFFER, prevFboId);
+
+    lightmap.bakedState = state;
+}
 
-    location = glGetUniformLocation(programId, "u_isBezTexed");
-    glUniform1i(location, bezLight.isBezTexed);
+void LtcSurface::drawSurface(const Camera &camera, const BezierLightSet &bezLights) {
+    if (isLightmap) {
+        bakeLightmap(camera, bezLights);
+    }
+
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+
+    // The generic program shades forward, from vertex attributes, so the
+    // full-screen passes wait for their variants and the frame is drawn
+    // forward until then (the scene stays dirty while shaders are pending)
+    const bool isLowResEnabled = lowResScale > 1 && !isLightmap;
+    bool isDeferredFrame = false;
+    if (isDeferred) {
+        const GLuint genericId = shaders.get("");
+        const bool isShadeReady = shaders.get(variantDefines(bezLights)) != genericId;
+        const bool isLowResReady =
+            !isLowResEnabled || shaders.get(variantDefines(bezLights, LTC_PASS_LOWRES)) != genericId;
+        isDeferredFrame = isShadeReady && isLowResReady;
+    }
+
+    // Deferred mode rasterizes the receivers first, so that the LTC
+    // integration below runs once per visible pixel regardless of overdraw.
+    // The depth pre-pass gets the same from early-Z in forward mode.
+    const bool isPrepass = isDeferredFrame || isDepthPrepass;
+    if (isPrepass) {
+        prepassTimer.begin();
+        if (isDeferredFrame) {
+            drawGBuffer(camera, viewport[2], viewport[3]);
+        } else {
+            drawDepth(camera);
+            glDepthFunc(GL_EQUAL);
+            glDepthMask(GL_FALSE);
+        }
+        prepassTimer.end();
+    }
+
+    if (isTiledCulling) {
+        const float maxAlpha = isRoughTexed ? maxRoughTexAlpha : alpha;
+        lightCulling.update(camera, bezLights, receiverPlane(), maxAlpha, viewport[2], viewport[3]);
+    }
+
+    ltcTimer.begin();
+
+    // Diffuse (and rough specular) lighting is smooth, so it is integrated
+    // once per block of pixels first and upsampled by the full-res pass.
+    const bool isLowRes = isDeferredFrame && isLowResEnabled;
+    if (isLowRes) {
+        const int width = (viewport[2] + lowResScale - 1) / lowResScale;
+        const int height = (viewport[3] + lowResScale - 1) / lowResScale;
+        lowResBuffer.resize(width, height);
+
+        GLint prevFboId;
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &prevFboId);
+        glBindFramebuffer(GL_FRAMEBUFFER, lowResBuffer.fboId);
+        glViewport(0, 0, width, height);
+        glDisable(GL_DEPTH_TEST);
+        lowResBuffer.clear();
+
+        programId = shaders.get(variantDefines(bezLights, LTC_PASS_LOWRES));
+        glUseProgram(programId);
+        bindLightingUniforms(camera, bezLights);
+        drawScreenTriangle();
+
+        glEnable(GL_DEPTH_TEST);
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+        glBindFramebuffer(GL_FRAMEBUFFER, prevFboId);
+    }
+
+    if (isDeferred && !isDeferredFrame) {
+        programId = shaders.get("");
+    } else {
+        useShaderVariant(bezLights);
+    }
+    glUseProgram(programId);
+    bindLightingUniforms(camera, bezLights);
+
+    if (isDeferredFrame) {
+        drawScreenTriangle();
+    } else {
+        const BezierLight &bezLight = bezLights.lights[0];
+        draw(camera, bezLight.center, bezLight.Le);
+    }
+
+    ltcTimer.end();
+
+    if (isPrepass && !isDeferredFrame) {
+        glDepthFunc(GL_LESS);
+        glDepthMask(GL_TRUE);
+    }
+}
+
+void LtcSurface::bindLightingUniforms(const Camera &camera, const BezierLightSet &bezLights, LtcPass pass) {
+    GLuint location = glGetUniformLocation(programId, "u_alpha");
+    glUniform1f(location, alpha);
+
+    location = glGetUniformLocation(programId, "u_isRoughTexed");
+    glUniform1i(location, isRoughTexed);
+
+    location = glGetUniformLocation(programId, "u_cameraPos");
+    glUniform3fv(location, 1, glm::value_ptr(camera.cameraPos));
+
+    // the bake has no pixels to speak of, its footprint is left out
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    location = glGetUniformLocation(programId, "u_pixelAngle");
+    glUniform1f(location, pass == LTC_PASS_LIGHTMAP_BAKE ? 0.0f : 2.0f / (camera.projMat[1][1] * viewport[3]));
+
+    location = glGetUniformLocation(programId, "u_polygonAlpha");
+    glUniform1f(location, polygonAlpha);
 
     location = glGetUniformLocation(programId, "u_ltcMatTex");
     glActiveTexture(GL_TEXTURE0);
@@ -161,32 +466,48 @@ void LtcSurface::drawSurface(const Camera &camera, const BezierLight bezLight) {
         glUniform1i(location, 2);
     }
 
-    if (bezLight.isBezTexed) {
-        location = glGetUniformLocation(programId, "u_bezLightMmat");
-        glUniformMatrix4fv(location, 1, false, glm::value_ptr(bezLight.modelMat));
+    //location = glGetUniformLocation(programId, "u_bernCoeffTex");
+    //glActiveTexture(GL_TEXTURE4);
+    //glBindTexture(GL_TEXTURE_1D, bezLight.bernCoeffTexId);
+    //glUniform1i(location, 4);
+
+    // control points, light records and light textures
+    bezLights.bindTextures(programId, 5);
+    int unit = 5 + bezLights.numTextureUnits();
 
-        location = glGetUniformLocation(programId, "u_texWidth");
-        glUniform1i(location, bezLight.texWidth);
+    if (pass == LTC_PASS_LIGHTMAP_BAKE) {
+        return;
+    }
 
-        location = glGetUniformLocation(programId, "u_texHeight");
-        glUniform1i(location, bezLight.texHeight);
+    if (isTiledCulling) {
+        lightCulling.bindTextures(programId, unit);
+        unit += 2;
+    }
 
-        location = glGetUniformLocation(programId, "u_marginSize");
-        glUniform1i(location, bezLight.marginSize);
+    if (isDeferred) {
+        gBuffer.bindTextures(programId, unit);
+        unit += NUM_GBUFFER_TARGETS;
 
-        location = glGetUniformLocation(programId, "u_maxLOD");
-        glUniform1i(location, bezLight.maxLOD);
+        location = glGetUniformLocation(programId, "u_lowResScale");
+        glUniform1i(location, lowResScale);
 
-        location = glGetUniformLocation(programId, "u_bezLightTex");
-        glActiveTexture(GL_TEXTURE3);
-        glBindTexture(GL_TEXTURE_2D, bezLight.bezLightTexId);
-        glUniform1i(location, 3);
-    }
+        // specular is never shaded at low resolution above alpha = 1
+        location = glGetUniformLocation(programId, "u_lowResSpecAlpha");
+        glUniform1f(location, isLowResSpec ? lowResSpecAlpha : 2.0f);
 
-    //location = glGetUniformLocation(programId, "u_bernCoeffTex");
-    //glActiveTexture(GL_TEXTURE4);
-    //glBindTexture(GL_TEXTURE_1D, bezLight.bernCoeffTexId);
-    //glUniform1i(location, 4);
+        lowResBuffer.bindTextures(programId, unit);
+    } else if (isLightmap) {
+        // the G-buffer pass applies the lightmap in deferred mode
+        lightmap.bindTexture(programId, unit);
+    }
+}
 
-    draw(camera, bezLight.center, bezLight.Le);
+void LtcSurface::drawScreenTriangle() {
+    // full-screen triangle generated from gl_VertexID
+    if (screenVaoId == 0) {
+        glGenVertexArrays(1, &screenVaoId);
+    }
+    glBindVertexArray(screenVaoId);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glBindVertexArray(0);
 }
@@ -1,19 +1,111 @@
 #pragma once
 
-#include "bezierLight.h"
+#include "bezierLightSet.h"
+#include "gBuffer.h"
+#include "gpuTimer.h"
+#include "lightCulling.h"
+#include "lightmap.h"
 #include "render.h"
 
+// Horizon clipping method used in floorLTC.frag (CLIP_METHOD)
+enum ClipMethod {
+    CLIP_ALGEBRAIC = 0,
+    CLIP_BEZIER = 1,
+    CLIP_POLYGON = 2,
+    CLIP_NEWTON = 3,
+};
+
+// Per-pixel cost shown by the heatmap view of floorLTC.frag (COST_METRIC)
+enum CostMetric {
+    COST_NONE = 0,
+    COST_EDGES = 1,      // edges integrated
+    COST_CURVES = 2,     // curves clipped or integrated
+    COST_CROSSINGS = 3,  // curves straddling the horizon, roots searched
+    COST_ROOTS = 4,      // horizon roots found
+};
+
+// Passes of floorLTC.frag besides the final shading
+enum LtcPass {
+    LTC_PASS_SHADE = 0,
+    LTC_PASS_LOWRES = 1,
+    LTC_PASS_LIGHTMAP_BAKE = 2,
+};
+
 struct LtcSurface : public RenderObject {
     void initialize();
+    glm::vec4 receiverPlane() const;
     void createLTCmatTex();
     void createLTCmagTex();
     void createRoughnessTex(const std::string &filename);
 
-    void drawSurface(const Camera &camera, const BezierLight bezLight);
+    std::string variantDefines(const BezierLightSet &bezLights, LtcPass pass = LTC_PASS_SHADE) const;
+    void useShaderVariant(const BezierLightSet &bezLights);
+    void drawDepth(const Camera &camera);
+    void drawGBuffer(const Camera &camera, int width, int height);
+    void bakeLightmap(const Camera &camera, const BezierLightSet &bezLights);
+    void drawSurface(const Camera &camera, const BezierLightSet &bezLights);
+    void bindLightingUniforms(const Camera &camera, const BezierLightSet &bezLights,
+                              LtcPass pass = LTC_PASS_SHADE);
+    void drawScreenTriangle();
 
     float alpha;
     GLuint ltcMatTexId;
     GLuint ltcMagTexId;
     GLuint roughnessTexId;
     bool isRoughTexed;
+    float maxRoughTexAlpha;
+
+    ClipMethod clipMethod;
+    CostMetric costMetric;
+    bool isCostRaw;        // every counter to a float target, see CostStats
+    bool isShowRootError;  // error of the horizon roots instead of the shading
+
+    // initial divisions and DP threshold from the solid angle of each light
+    // and the pixel footprint, instead of fixed ones
+    bool isAdaptiveSubdiv;
+    bool isShowEdgeSaving;  // edge count view shows the edges saved instead
+
+    // curves are integrated with fixed-order Gauss-Legendre quadrature (4, 8
+    // or 16 nodes) instead of DP subdivision when gaussOrder is not 0
+    int gaussOrder;
+    int referenceChords;    // if not 0, equal chords per curve for benchmarks
+
+    // specular integrates the flattened contour (see BezierLight::flattenCurves)
+    // from polygonAlpha, blended with the curves just below it
+    bool isPolygonFallback;
+    float polygonAlpha;
+
+    // diffuse integrates the contour clipped by receiverPlane() on the CPU
+    bool isPreclipped;
+
+    // simplified light shapes where their error is below the lobe width
+    bool isLightLOD;
+
+    LightCulling lightCulling;
+    bool isTiledCulling;
+
+    // deferred mode: G-buffer pass, then one full-screen LTC pass
+    ShaderVariants gBufferShaders;
+    GBuffer gBuffer;
+    GLuint screenVaoId;
+    bool isDeferred;
+
+    // deferred mode: diffuse (and specular from lowResSpecAlpha) integrated
+    // once per lowResScale x lowResScale block, then upsampled
+    LowResBuffer lowResBuffer;
+    int lowResScale;
+    bool isLowResSpec;
+    float lowResSpecAlpha;
+
+    // diffuse baked in texture space, only specular is integrated per frame
+    Lightmap lightmap;
+    bool isLightmap;
+
+    // forward mode: depth pre-pass, then the LTC pass with GL_EQUAL
+    ShaderVariants depthShaders;
+    bool isDepthPrepass;
+
+    // pre-pass (depth or G-buffer) and LTC pass
+    GpuTimer prepassTimer;
+    GpuTimer ltcTimer;
 };
\ No newline at end of file
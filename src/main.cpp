@@ -1,9 +1,13 @@
 ﻿#include <algorithm>
+#include <cfloat>
+#include <cmath>
 #include <cstddef>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <ctime>
 #include <iostream>
+#include <iterator>
 #include <memory>
 #include <vector>
 
@@ -32,20 +36,93 @@
 #include <imgui_impl_opengl3.h>
 
 #include "bezierLight.h"
+#include "bezierLightSet.h"
 #include "constants.h"
+#include "costStats.h"
+#include "cpuProfiler.h"
+#include "dynamicResolution.h"
+#include "frameStats.h"
+#include "gpuTimer.h"
 #include "ltcSurface.h"
 #include "render.h"
+#include "sceneBuffer.h"
+#include "shaderCache.h"
+#include "shaderCompiler.h"
 
 static LtcSurface ltcFloor;
-static BezierLight bezLight;
+static BezierLightSet bezLights;
+static int numLights = 1;
+static bool isTiledCulling = true;
+static bool isPreclipped = true;
+static bool isAdaptiveSubdiv = true;
+static bool isLightLOD = true;
+static int gaussOrder = 0;
+static bool isPolygonFallback = true;
+static bool isBenchmark = false;
+static bool isClipBenchmark = false;
+static const char *costCsvFilename = nullptr;  // cost statistics of every shape
+static const char *cpuProfileFilename = nullptr;  // CPU trace recorded from startup, saved at exit
+static const char *frameStatsFilename = nullptr;  // frame times saved at exit
+static ClipMethod clipMethod = CLIP_ALGEBRAIC;
+static bool isDeferred = false;
+static int lowResScale = 1;
+static bool isDepthPrepass = false;
+static bool isLightmap = false;
+static double renderBudgetMs = 0.0;  // dynamic resolution when not 0
 static Camera camera;
 static bool isAnim = false;
 
+static SceneBuffer sceneBuffer;
+static DynamicResolution dynamicResolution;
+
+// GPU time of the passes besides the floor ones (see LtcSurface)
+static GpuTimer lightTimer;
+static GpuTimer guiTimer;
+static bool isShowTimings = true;
+static FrameStats frameStats;
+
+static CostStats costStats;
+static bool isCostStatsRequested = false;
+static std::vector<float> drawnSceneState;
+static bool isRenderOnDemand = true;
+
 static constexpr double Pi = 3.14159265358979;
 
 #define SAVE_MOVIE 0
 
+// Additional lights are copies of the first one placed around it
+void setLightCount(int count) {
+    CPU_PROFILE_SCOPE("setLightCount");
+
+    static const glm::vec3 offsets[] = {
+        glm::vec3(-4.5f, 0.0f, -2.0f),
+        glm::vec3(4.5f, 0.0f, -2.0f),
+        glm::vec3(0.0f, 0.0f, -5.0f),
+        glm::vec3(-4.5f, 0.0f, -7.0f),
+        glm::vec3(4.5f, 0.0f, -7.0f),
+        glm::vec3(-9.0f, 0.0f, -4.0f),
+        glm::vec3(9.0f, 0.0f, -4.0f),
+    };
+    static const glm::vec3 tints[] = {
+        glm::vec3(1.0f, 0.6f, 0.3f),
+        glm::vec3(0.3f, 0.6f, 1.0f),
+        glm::vec3(0.6f, 1.0f, 0.4f),
+    };
+
+    bezLights.lights.resize(1);
+    const BezierLight first = bezLights.lights[0];
+    for (int i = 1; i < count; i++) {
+        BezierLight light = first;
+        light.translate = first.translate + offsets[(i - 1) % IM_ARRAYSIZE(offsets)];
+        light.Le = tints[(i - 1) % IM_ARRAYSIZE(tints)];
+        light.calcCPSworld();
+        bezLights.lights.push_back(light);
+    }
+}
+
 void initializeGL() {
+    CPU_PROFILE_SCOPE("initializeGL");
+
     glEnable(GL_DEPTH_TEST);
     glDisable(GL_CULL_FACE);
 
@@ -59,6 +136,8 @@ void initializeGL() {
         ltcFloor.initialize();
         ltcFloor.loadOBJ(PLANE_OBJ);
         ltcFloor.buildShader(FLOORLTC_SHADER);
+        ltcFloor.gBufferShaders.initialize(FLOORGBUFFER_SHADER);
+        ltcFloor.depthShaders.initialize(FLOORDEPTH_SHADER);
         ltcFloor.modelMat = glm::scale(glm::vec3(1.0f, 1.0f, 1.0f));
         ltcFloor.diffColor = glm::vec3(1.0f);
         ltcFloor.specColor = glm::vec3(1.0f);
@@ -75,9 +154,14 @@ void initializeGL() {
 
     // Bezier-curve light
     {
+        bezLights.initialize();
+        bezLights.lights.resize(1);
+
+        BezierLight &bezLight = bezLights.lights[0];
         bezLight.initialize();
         bezLight.loadOBJ(SMALLPLANE_OBJ);
-        bezLight.buildShader(BEZLIGHT_SHADER);
+        bezLights.shaders.initialize(BEZLIGHT_SHADER);
+        bezLight.programId = bezLights.shaders.get("");
         bezLight.Le = glm::vec3(1.0f);
 
         // create bezier curve points in normalized model space, then transform to world space
@@ -104,27 +188,331 @@ void initializeGL() {
     }
 }
 
-void draw(bool isShowGui = true) {
+// Everything the rendered scene depends on, flattened for comparison
+std::vector<float> sceneState() {
+    std::vector<float> state;
+    const auto push = [&state](const float *values, int count) {
+        state.insert(state.end(), values, values + count);
+    };
+
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    state.insert(state.end(), viewport, viewport + 4);
+    push(glm::value_ptr(camera.viewMat), 16);
+    push(glm::value_ptr(camera.projMat), 16);
+
+    for (const auto &bezLight : bezLights.lights) {
+        push(glm::value_ptr(bezLight.modelMat), 16);
+        push(glm::value_ptr(bezLight.Le), 3);
+        if (!bezLight.cpsWorld.empty()) {
+            push(glm::value_ptr(bezLight.cpsWorld[0]), 3 * (int) bezLight.cpsWorld.size());
+        }
+        state.push_back(bezLight.isTwoSided);
+        state.push_back(bezLight.isBezTexed);
+        state.push_back((float) bezLight.bezLightTexId);
+    }
+
+    push(glm::value_ptr(ltcFloor.modelMat), 16);
+    push(glm::value_ptr(ltcFloor.diffColor), 3);
+    push(glm::value_ptr(ltcFloor.specColor), 3);
+    state.push_back(ltcFloor.alpha);
+    state.push_back(ltcFloor.isRoughTexed);
+    state.push_back(ltcFloor.clipMethod);
+    state.push_back(ltcFloor.costMetric);
+    state.push_back(ltcFloor.isShowRootError);
+    state.push_back(ltcFloor.isPreclipped);
+    state.push_back(ltcFloor.isAdaptiveSubdiv);
+    state.push_back(ltcFloor.isShowEdgeSaving);
+    state.push_back(ltcFloor.isLightLOD);
+    state.push_back(ltcFloor.gaussOrder);
+    state.push_back(ltcFloor.referenceChords);
+    state.push_back(ltcFloor.isPolygonFallback);
+    state.push_back(ltcFloor.polygonAlpha);
+    state.push_back(ltcFloor.isTiledCulling);
+    state.push_back(ltcFloor.isDeferred);
+    state.push_back(ltcFloor.isDepthPrepass);
+    state.push_back(ltcFloor.lowResScale);
+    state.push_back(ltcFloor.isLowResSpec);
+    state.push_back(ltcFloor.lowResSpecAlpha);
+    state.push_back(ltcFloor.isLightmap);
+    // The scale itself is left out: the controller corrects it from timer
+    // results that come back frames later, which would keep an idle scene
+    // redrawing. A new scale is used from the next redraw.
+    state.push_back(dynamicResolution.isEnabled);
+    state.push_back(dynamicResolution.budgetMs);
+
+    // modified shader sources
+    state.push_back(shaderGeneration());
+    return state;
+}
+
+// The scene needs to be drawn again when its state differs from the last
+// drawn one, or while a shader variant it will switch to is being compiled.
+bool isSceneDirty() {
+    if (ltcFloor.shaders.isPending() || ltcFloor.gBufferShaders.isPending() || ltcFloor.depthShaders.isPending()) {
+        return true;
+    }
+    return sceneState() != drawnSceneState;
+}
+
+void drawScene(int width, int height) {
+    CPU_PROFILE_SCOPE("drawScene");
+
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+
+    sceneBuffer.resize(width, height);
+    glBindFramebuffer(GL_FRAMEBUFFER, sceneBuffer.fboId);
+    glViewport(0, 0, width, height);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
 
     // bezierLight
-    {
+    lightTimer.begin();
+    for (auto &bezLight : bezLights.lights) {
+        // each light shape is drawn with its own stencil mask
+        glClear(GL_STENCIL_BUFFER_BIT);
+
         GLuint programId = bezLight.programId;
         glUseProgram(programId);
-        bezLight.drawBez(camera);
+        bezLight.drawBez(camera, bezLights.shaders);
         glUseProgram(0);
     }
+    lightTimer.end();
 
     // ltcFloor
     {
+        bezLights.upload(ltcFloor.receiverPlane());
+
         GLuint programId = ltcFloor.programId;
         glUseProgram(programId);
-        ltcFloor.drawSurface(camera, bezLight);
+        ltcFloor.drawSurface(camera, bezLights);
         glUseProgram(0);
     }
 
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    drawnSceneState = sceneState();
+}
+
+// Per-pixel counters of the floor LTC pass in the current view, reduced by
+// CostStats. The lights are drawn into depth only, so that they hide the
+// floor behind them as in the frame. Draws until the COST_RAW variant is
+// ready, as the generic program writes colors.
+void collectCostStats(int width, int height) {
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+
+    costStats.resize(width, height);
+    glBindFramebuffer(GL_FRAMEBUFFER, costStats.fboId);
+    glViewport(0, 0, width, height);
+    bezLights.upload(ltcFloor.receiverPlane());
+
+    ltcFloor.isCostRaw = true;
+    do {
+        const GLfloat zero[] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        glClearBufferfv(GL_COLOR, 0, zero);
+        glClear(GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        for (auto &bezLight : bezLights.lights) {
+            glClear(GL_STENCIL_BUFFER_BIT);
+            glUseProgram(bezLight.programId);
+            bezLight.drawBez(camera, bezLights.shaders);
+        }
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+
+        glUseProgram(ltcFloor.programId);
+        ltcFloor.drawSurface(camera, bezLights);
+        glUseProgram(0);
+        glFinish();
+    } while (ltcFloor.shaders.isPending());
+    ltcFloor.isCostRaw = false;
+
+    costStats.reduce();
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+}
+
+void saveCpuTrace() {
+    time_t now = time(0);
+    char filename[128];
+    strftime(filename, sizeof(filename), "cpu_profile_%Y%m%d_%H%M%S.json", localtime(&now));
+    saveCpuProfile(filename);
+}
+
+void saveFrameStats() {
+    time_t now = time(0);
+    char filename[128];
+    strftime(filename, sizeof(filename), "frame_times_%Y%m%d_%H%M%S.csv", localtime(&now));
+    frameStats.save(filename);
+}
+
+// Percentiles and histograms of the recorded frame times
+void drawFrameStats() {
+    ImGui::Text("Last %d frames, %d with every pass timed (ms)", frameStats.cpuMs.count(), frameStats.gpuMs.count());
+    if (ImGui::BeginTable("frame times", 6, ImGuiTableFlags_Borders | ImGuiTableFlags_SizingFixedFit)) {
+        const char *headers[] = { "", "avg", "p50", "p95", "p99", "max" };
+        for (const char *header : headers) {
+            ImGui::TableSetupColumn(header);
+        }
+        ImGui::TableHeadersRow();
+
+        const RollingStats *series[] = { &frameStats.cpuMs, &frameStats.gpuMs };
+        const char *names[] = { "CPU", "GPU" };
+        for (int i = 0; i < 2; i++) {
+            const double values[] = { series[i]->mean(), series[i]->percentile(50.0), series[i]->percentile(95.0),
+                                      series[i]->percentile(99.0), series[i]->max() };
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::TextUnformatted(names[i]);
+            for (double value : values) {
+                ImGui::TableNextColumn();
+                ImGui::Text("%.3f", value);
+            }
+        }
+        ImGui::EndTable();
+    }
+
+    // spikes in order, then the distribution of both series on one scale
+    const auto getter = [](void *data, int i) { return (float) ((const RollingStats *) data)->sample(i); };
+    ImGui::PlotLines("CPU##frames", getter, (void *) &frameStats.cpuMs, frameStats.cpuMs.count(), 0, nullptr, 0.0f,
+                     FLT_MAX, ImVec2(0.0f, 50.0f));
+
+    char overlay[64];
+    sprintf(overlay, "0 - %.1f ms", frameStats.histogramMaxMs());
+    float bins[FRAME_HISTOGRAM_BINS];
+    frameStats.histogram(frameStats.cpuMs, bins);
+    ImGui::PlotHistogram("CPU##histogram", bins, FRAME_HISTOGRAM_BINS, 0, overlay, 0.0f, FLT_MAX, ImVec2(0.0f, 50.0f));
+    frameStats.histogram(frameStats.gpuMs, bins);
+    ImGui::PlotHistogram("GPU##histogram", bins, FRAME_HISTOGRAM_BINS, 0, overlay, 0.0f, FLT_MAX, ImVec2(0.0f, 50.0f));
+
+    if (ImGui::Button("Save frame times")) {
+        saveFrameStats();
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Reset")) {
+        frameStats.clear();
+    }
+}
+
+void saveCostStats() {
+    time_t now = time(0);
+    char filename[128];
+    strftime(filename, sizeof(filename), "cost_%Y%m%d_%H%M%S.csv", localtime(&now));
+
+    FILE *fp = fopen(filename, "w");
+    if (fp == NULL) {
+        fprintf(stderr, "Failed to open file: %s\n", filename);
+        return;
+    }
+    CostStats::writeCSVHeader(fp);
+    costStats.writeCSV(fp, "view");
+    fclose(fp);
+    printf("Cost statistics saved: %s\n", filename);
+}
+
+// GPU time of the passes that scale with the resolution
+double sceneGpuMs() {
+    const bool isPrepass = ltcFloor.isDeferred || ltcFloor.isDepthPrepass;
+    return ltcFloor.ltcTimer.elapsedMs + (isPrepass ? ltcFloor.prepassTimer.elapsedMs : 0.0);
+}
+
+// Adds the frame that just ended with the passes timed in it, then the
+// results that came back for this and earlier frames
+void recordFrameTimes(double cpuMs) {
+    GpuTimer *timers[] = { &lightTimer, &ltcFloor.prepassTimer, &ltcFloor.ltcTimer, &guiTimer };
+    const int frame = frameStats.numFrames;
+
+    int numGpuPasses = 0;
+    bool isGpuTimed = true;
+    for (GpuTimer *timer : timers) {
+        if (timer->lastFrame == frame) {
+            numGpuPasses += timer->numBegun - timer->numSkipped;
+            isGpuTimed = isGpuTimed && timer->numSkipped == 0;
+        }
+    }
+    frameStats.add(cpuMs, numGpuPasses, isGpuTimed);
+
+    for (GpuTimer *timer : timers) {
+        timer->poll();
+        for (const GpuTimerResult &result : timer->results) {
+            frameStats.addGpuResult(result.frame, result.ms);
+        }
+        timer->results.clear();
+    }
+}
+
+// Recent GPU time of each pass, in ms
+void drawTimingOverlay() {
+    struct Pass {
+        const char *name;
+        const GpuTimer &timer;
+    };
+    const bool isPrepass = ltcFloor.isDeferred || ltcFloor.isDepthPrepass;
+    const Pass passes[] = {
+        { "Light stencil", lightTimer },
+        { isPrepass ? (ltcFloor.isDeferred ? "G-buffer" : "Depth pre-pass") : nullptr, ltcFloor.prepassTimer },
+        { "Floor LTC", ltcFloor.ltcTimer },
+        { "ImGui", guiTimer },
+    };
+
+    // pinned to the top right, clear of the status window
+    const ImGuiViewport *viewport = ImGui::GetMainViewport();
+    ImGui::SetNextWindowPos(ImVec2(viewport->WorkPos.x + viewport->WorkSize.x - 10.0f, viewport->WorkPos.y + 10.0f),
+                            ImGuiCond_Always, ImVec2(1.0f, 0.0f));
+    ImGui::Begin("GPU timings", nullptr, ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoMove);
+    ImGui::Text("Last %d results of each pass (ms)", ROLLING_STATS_SIZE);
+    if (ImGui::BeginTable("timings", 8, ImGuiTableFlags_Borders | ImGuiTableFlags_SizingFixedFit)) {
+        const char *headers[] = { "pass", "last", "avg", "min", "max", "p50", "p95", "p99" };
+        for (const char *header : headers) {
+            ImGui::TableSetupColumn(header);
+        }
+        ImGui::TableHeadersRow();
+
+        for (const Pass &pass : passes) {
+            if (pass.name == nullptr) {
+                continue;
+            }
+            const RollingStats &history = pass.timer.history;
+            const double values[] = { history.latest(),         history.mean(),
+                                      history.min(),            history.max(),
+                                      history.percentile(50.0), history.percentile(95.0),
+                                      history.percentile(99.0) };
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::TextUnformatted(pass.name);
+            for (double value : values) {
+                ImGui::TableNextColumn();
+                ImGui::Text("%.3f", value);
+            }
+        }
+        ImGui::EndTable();
+    }
+    ImGui::End();
+}
+
+void draw(bool isShowGui = true) {
+    CPU_PROFILE_SCOPE("draw");
+
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+
+    if (isCostStatsRequested) {
+        collectCostStats(dynamicResolution.scaled(viewport[2]), dynamicResolution.scaled(viewport[3]));
+        isCostStatsRequested = false;
+    }
+
+    // Present the previous frame again when nothing has changed
+    // The scene is rendered at the dynamic scale and upsampled to the window
+    if (!isRenderOnDemand || isSceneDirty()) {
+        drawScene(dynamicResolution.scaled(viewport[2]), dynamicResolution.scaled(viewport[3]));
+        dynamicResolution.update(sceneGpuMs());
+    }
+    sceneBuffer.blitToScreen(viewport[2], viewport[3]);
+
     // ImGui
     if (isShowGui) {
+        CPU_PROFILE_SCOPE("ImGui");
         ImGui_ImplOpenGL3_NewFrame();
         ImGui_ImplGlfw_NewFrame();
         ImGui::NewFrame();
@@ -144,12 +532,142 @@ void draw(bool isShowGui = true) {
 
         static int a = 0;
         ImGui::Text("Roughness:");
-        const char *alpha_chars[] = {"checker", "0.01", "0.1", "0.25", "0.4"};
+        const char *alpha_chars[] = {"checker", "0.01", "0.1", "0.25", "0.4", "0.7"};
         ImGui::Combo("  ", &a, alpha_chars, IM_ARRAYSIZE(alpha_chars));
 
+        int c = (int) ltcFloor.clipMethod;
+        ImGui::Text("Clipping:");
+        const char *clip_chars[] = {"algebraic", "Bezier clipping", "uniform polygon", "Newton (bracketed)"};
+        ImGui::Combo("   ", &c, clip_chars, IM_ARRAYSIZE(clip_chars));
+        ltcFloor.clipMethod = (ClipMethod) c;
+        if (ltcFloor.clipMethod != CLIP_POLYGON) {
+            ImGui::Checkbox("Root error", &ltcFloor.isShowRootError);
+            ImGui::Checkbox("Pre-clipped diffuse", &ltcFloor.isPreclipped);
+            ImGui::Checkbox("Polygon for rough specular", &ltcFloor.isPolygonFallback);
+            if (ltcFloor.isPolygonFallback) {
+                ImGui::SliderFloat("from alpha ", &ltcFloor.polygonAlpha, 0.2f, 1.0f);
+            }
+        }
+
+        BezierLight &bezLight = bezLights.lights[0];
+        const int prevNumLights = numLights;
+        ImGui::SliderInt("Lights", &numLights, 1, 8);
+
         ImGui::Checkbox("Animate", &isAnim);
-        ImGui::Checkbox("Light move", &bezLight.isMove);
-        ImGui::Checkbox("Two-side", &bezLight.isTwoSided);
+        // set on every light when changed, lights may differ otherwise
+        if (ImGui::Checkbox("Light move", &bezLight.isMove)) {
+            for (auto &light : bezLights.lights) {
+                light.isMove = bezLight.isMove;
+            }
+        }
+        if (ImGui::Checkbox("Two-side", &bezLight.isTwoSided)) {
+            for (auto &light : bezLights.lights) {
+                light.isTwoSided = bezLight.isTwoSided;
+            }
+        }
+        int g = ltcFloor.gaussOrder == 0 ? 0 : ltcFloor.gaussOrder == 4 ? 1 : ltcFloor.gaussOrder == 8 ? 2 : 3;
+        ImGui::Text("Curve integration:");
+        const char *integ_chars[] = {"DP subdivision", "Gauss-Legendre 4", "Gauss-Legendre 8", "Gauss-Legendre 16"};
+        ImGui::Combo("     ", &g, integ_chars, IM_ARRAYSIZE(integ_chars));
+        ltcFloor.gaussOrder = g == 0 ? 0 : 2 << g;
+        if (ltcFloor.gaussOrder == 0) {
+            ImGui::Checkbox("Adaptive subdivision", &ltcFloor.isAdaptiveSubdiv);
+        }
+        int v = (int) ltcFloor.costMetric;
+        ImGui::Text("Cost view:");
+        const char *cost_chars[] = {"off", "edges", "curves", "horizon straddles", "roots"};
+        ImGui::Combo("      ", &v, cost_chars, IM_ARRAYSIZE(cost_chars));
+        ltcFloor.costMetric = (CostMetric) v;
+        if (ltcFloor.costMetric == COST_EDGES && ltcFloor.isAdaptiveSubdiv && ltcFloor.gaussOrder == 0) {
+            ImGui::Checkbox("Edges saved by adaptive", &ltcFloor.isShowEdgeSaving);
+        }
+        if (ImGui::Button("Collect cost statistics")) {
+            isCostStatsRequested = true;
+        }
+        if (costStats.numPixels > 0) {
+            ImGui::SameLine();
+            if (ImGui::Button("Export CSV")) {
+                saveCostStats();
+            }
+            ImGui::Text("Floor pixels: %d", costStats.numPixels);
+            for (int metric = 0; metric < NUM_COST_METRICS; metric++) {
+                ImGui::Text("%-10s total %.0f, mean %.2f, max %d", CostStats::metricName(metric),
+                            costStats.totals[metric], costStats.totals[metric] / costStats.numPixels,
+                            costStats.maxima[metric]);
+            }
+
+            // histogram of the viewed metric, edges when the view is off
+            const int metric = std::max(0, (int) ltcFloor.costMetric - 1);
+            float bins[COST_HISTOGRAM_BINS];
+            std::copy(costStats.histograms[metric], costStats.histograms[metric] + COST_HISTOGRAM_BINS, bins);
+            char overlay[64];
+            sprintf(overlay, "%s, %d per bin", CostStats::metricName(metric), costStats.binWidths[metric]);
+            ImGui::PlotHistogram("##cost", bins, COST_HISTOGRAM_BINS, 0, overlay, 0.0f, FLT_MAX, ImVec2(0.0f, 60.0f));
+        }
+        ImGui::Checkbox("Light LOD", &ltcFloor.isLightLOD);
+        ImGui::Checkbox("Tiled culling", &ltcFloor.isTiledCulling);
+        if (ltcFloor.isTiledCulling) {
+            ImGui::Text("Lights/tile: %.2f (specular %.2f)", ltcFloor.lightCulling.avgLightsPerTile,
+                        ltcFloor.lightCulling.avgSpecLightsPerTile);
+        }
+        ImGui::Checkbox("Baked diffuse", &ltcFloor.isLightmap);
+        ImGui::Checkbox("Deferred", &ltcFloor.isDeferred);
+        if (!ltcFloor.isDeferred) {
+            ImGui::Checkbox("Depth pre-pass", &ltcFloor.isDepthPrepass);
+        } else if (!ltcFloor.isLightmap) {
+            int r = ltcFloor.lowResScale == 4 ? 2 : ltcFloor.lowResScale - 1;
+            ImGui::Text("Diffuse resolution:");
+            const char *res_chars[] = {"full", "1/2", "1/4"};
+            ImGui::Combo("    ", &r, res_chars, IM_ARRAYSIZE(res_chars));
+            ltcFloor.lowResScale = 1 << r;
+            if (ltcFloor.lowResScale > 1) {
+                ImGui::Checkbox("Low-res specular", &ltcFloor.isLowResSpec);
+                if (ltcFloor.isLowResSpec) {
+                    ImGui::SliderFloat("from alpha", &ltcFloor.lowResSpecAlpha, 0.1f, 1.0f);
+                }
+            }
+        }
+        if (ltcFloor.isDeferred || ltcFloor.isDepthPrepass) {
+            ImGui::Text("Floor GPU: pre-pass %.2f ms, LTC %.2f ms", ltcFloor.prepassTimer.elapsedMs,
+                        ltcFloor.ltcTimer.elapsedMs);
+        } else {
+            ImGui::Text("Floor GPU: LTC %.2f ms", ltcFloor.ltcTimer.elapsedMs);
+        }
+
+        ImGui::Checkbox("Dynamic resolution", &dynamicResolution.isEnabled);
+        if (dynamicResolution.isEnabled) {
+            float budgetMs = (float) dynamicResolution.budgetMs;
+            ImGui::SliderFloat("GPU budget (ms)", &budgetMs, 4.0f, 50.0f, "%.1f");
+            dynamicResolution.budgetMs = budgetMs;
+        }
+        ImGui::Text("Render scale: %.2f (%dx%d)", dynamicResolution.scale, sceneBuffer.width, sceneBuffer.height);
+
+        bool isHotReload = isShaderHotReloadEnabled();
+        ImGui::Checkbox("Hot reload", &isHotReload);
+        setShaderHotReload(isHotReload);
+
+        ImGui::Checkbox("Render on demand", &isRenderOnDemand);
+        ImGui::Checkbox("GPU timings", &isShowTimings);
+
+        bool isCpuProfiling = isCpuProfilingEnabled();
+        ImGui::Checkbox("Record CPU profile", &isCpuProfiling);
+        setCpuProfiling(isCpuProfiling);
+        const int numEvents = numCpuProfileEvents();
+        if (numEvents > 0) {
+            ImGui::SameLine();
+            if (ImGui::Button("Save trace")) {
+                saveCpuTrace();
+            }
+            ImGui::SameLine();
+            if (ImGui::Button("Clear")) {
+                clearCpuProfile();
+            }
+            ImGui::Text("CPU profile: %d events", numEvents);
+        }
+
+        if (ImGui::CollapsingHeader("Frame times")) {
+            drawFrameStats();
+        }
 
         static bool isVsync = true;
         ImGui::Checkbox("Vsync", &isVsync);
@@ -177,6 +695,10 @@ void draw(bool isShowGui = true) {
             ltcFloor.isRoughTexed = false;
             ltcFloor.alpha = 0.4;
             break;
+        case 5:
+            ltcFloor.isRoughTexed = false;
+            ltcFloor.alpha = 0.7;
+            break;
         }
 
         // ONE, TWO, THREE, FOUR, CAVITYLEAF, CLIP, QUAD, CHAR
@@ -221,8 +743,18 @@ void draw(bool isShowGui = true) {
             }
         }
 
+        if (s != prev_s || numLights != prevNumLights) {
+            setLightCount(numLights);
+        }
+
+        if (isShowTimings) {
+            drawTimingOverlay();
+        }
+
+        guiTimer.begin();
         ImGui::Render();
         ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        guiTimer.end();
     }
 }
 
@@ -263,7 +795,199 @@ void saveCurrentBuffer(GLFWwindow *window, const std::string &filename = "") {
     printf("Buffer saved: %s\n", outname.c_str());
 }
 
+// Built-in shapes measured by the benchmarks (--bench, --bench-clip)
+struct BenchmarkShape {
+    const char *name;
+    LightType type;
+};
+static const BenchmarkShape benchmarkShapes[] = {
+    { "teardrop", ONE }, { "torch", TWO },   { "tripod", THREE }, { "rainbow", FOUR },
+    { "cavity", CAVITY }, { "camel", CLIP }, { "quad", QUAD },    { "char", CHAR },
+};
+static constexpr int BENCHMARK_FRAMES = 32;
+
+// Untextured, so that only the integrals differ between runs
+void setBenchmarkShape(LightType type) {
+    BezierLight &bezLight = bezLights.lights[0];
+    bezLight.isBezTexed = false;
+    bezLight.createCPSmodel(type);
+    bezLight.calcCPSworld();
+    setLightCount(numLights);
+}
+
+// Draws until the shader variant of the current settings is ready, then
+// reads the image back
+void renderBenchmarkImage(int width, int height, std::vector<uint8_t> &pixels) {
+    do {
+        drawScene(width, height);
+        glFinish();
+    } while (ltcFloor.shaders.isPending());
+
+    pixels.resize(width * height * 4);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, sceneBuffer.fboId);
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, (void *) pixels.data());
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+// GPU time of the LTC pass and frame time averaged over BENCHMARK_FRAMES. The
+// frame time includes everything else drawn, but also works where timer
+// queries are unavailable.
+void timeBenchmarkFrames(int width, int height, double &ltcMs, double &frameMs) {
+    // skip the results of queries issued before the variant was ready
+    for (int i = 0; i < NUM_TIMER_QUERIES; i++) {
+        drawScene(width, height);
+    }
+
+    double totalMs = 0.0;
+    const double startTime = glfwGetTime();
+    for (int i = 0; i < BENCHMARK_FRAMES; i++) {
+        drawScene(width, height);
+        glFinish();
+        totalMs += ltcFloor.ltcTimer.elapsedMs;
+    }
+    ltcMs = totalMs / BENCHMARK_FRAMES;
+    frameMs = (glfwGetTime() - startTime) * 1000.0 / BENCHMARK_FRAMES;
+}
+
+// Time and error of each curve integrator on every built-in shape, printed
+// as a table. The error is measured against curves integrated as 256 equal
+// chords. High-order quadrature is no reference, as it rings where the
+// integrand of sharp reflections peaks.
+void runIntegratorBenchmark(int width, int height) {
+    struct Integrator {
+        const char *name;
+        int gaussOrder;
+    };
+    static const Integrator integrators[] = {
+        { "DP", 0 },
+        { "Gauss 4", 4 },
+        { "Gauss 8", 8 },
+        { "Gauss 16", 16 },
+    };
+
+    printf("%-10s %-10s %10s %10s %10s %8s\n", "shape", "integrator", "LTC ms", "frame ms", "mean err", "max err");
+    std::vector<uint8_t> refPixels, pixels;
+    for (const BenchmarkShape &shape : benchmarkShapes) {
+        setBenchmarkShape(shape.type);
+
+        ltcFloor.referenceChords = 256;
+        renderBenchmarkImage(width, height, refPixels);
+        ltcFloor.referenceChords = 0;
+
+        for (const Integrator &integrator : integrators) {
+            ltcFloor.gaussOrder = integrator.gaussOrder;
+            renderBenchmarkImage(width, height, pixels);
+            double ltcMs, frameMs;
+            timeBenchmarkFrames(width, height, ltcMs, frameMs);
+
+            // color channels only, the 8-bit scene buffer limits the resolution
+            double sumError = 0.0;
+            int maxError = 0;
+            for (int i = 0; i < width * height * 4; i++) {
+                if (i % 4 == 3) {
+                    continue;
+                }
+                const int error = std::abs((int) pixels[i] - (int) refPixels[i]);
+                sumError += error;
+                maxError = std::max(maxError, error);
+            }
+
+            printf("%-10s %-10s %10.3f %10.3f %10.4f %8d\n", shape.name, integrator.name, ltcMs, frameMs,
+                   sumError / (width * height * 3), maxError);
+        }
+    }
+}
+
+// Time and root accuracy of each horizon clipping method on every built-in
+// shape, printed as a table. Accuracy comes from the root error view
+// (SHOW_ROOT_ERROR), over the pixels where a curve crosses the horizon: the
+// mean and max error in t of the roots, the pixels whose error exceeds 1e-3
+// and the pixels where a root was missed.
+void runClippingBenchmark(int width, int height) {
+    struct Clipping {
+        const char *name;
+        ClipMethod method;
+    };
+    static const Clipping clippings[] = {
+        { "algebraic", CLIP_ALGEBRAIC },
+        { "Bezier", CLIP_BEZIER },
+        { "Newton", CLIP_NEWTON },
+        { "polygon", CLIP_POLYGON },
+    };
+
+    printf("%-10s %-10s %10s %10s %10s %10s %8s %8s\n", "shape", "clipping", "LTC ms", "frame ms", "mean err",
+           "max err", ">1e-3 %", "missed %");
+    std::vector<uint8_t> pixels;
+    for (const BenchmarkShape &shape : benchmarkShapes) {
+        setBenchmarkShape(shape.type);
+
+        for (const Clipping &clipping : clippings) {
+            ltcFloor.clipMethod = clipping.method;
+            renderBenchmarkImage(width, height, pixels);
+            double ltcMs, frameMs;
+            timeBenchmarkFrames(width, height, ltcMs, frameMs);
+
+            // the uniform polygon finds no roots to measure
+            if (clipping.method == CLIP_POLYGON) {
+                printf("%-10s %-10s %10.3f %10.3f %10s %10s %8s %8s\n", shape.name, clipping.name, ltcMs, frameMs,
+                       "-", "-", "-", "-");
+                continue;
+            }
+
+            ltcFloor.isShowRootError = true;
+            renderBenchmarkImage(width, height, pixels);
+            ltcFloor.isShowRootError = false;
+
+            // red is log10 of the error from -8 to 0, green the missed roots
+            // and alpha 0 marks the pixels with curves crossing the horizon
+            int numPixels = 0, numInaccurate = 0, numMissed = 0;
+            double sumLogError = 0.0, maxLogError = -8.0;
+            for (int i = 0; i < width * height; i++) {
+                const uint8_t *pixel = &pixels[i * 4];
+                if (pixel[3] != 0) {
+                    continue;
+                }
+                const double logError = pixel[0] / 255.0 * 8.0 - 8.0;
+                numPixels++;
+                sumLogError += logError;
+                maxLogError = std::max(maxLogError, logError);
+                numInaccurate += logError > -3.0 ? 1 : 0;
+                numMissed += pixel[1] > 0 ? 1 : 0;
+            }
+            const double toPercent = numPixels > 0 ? 100.0 / numPixels : 0.0;
+
+            printf("%-10s %-10s %10.3f %10.3f %10.2e %10.2e %8.3f %8.3f\n", shape.name, clipping.name, ltcMs, frameMs,
+                   std::pow(10.0, numPixels > 0 ? sumLogError / numPixels : -8.0), std::pow(10.0, maxLogError),
+                   numInaccurate * toPercent, numMissed * toPercent);
+        }
+    }
+}
+
+// Cost statistics of the current view on every built-in shape, one CSV row
+// per shape and metric (see CostStats::writeCSV)
+void runCostStatistics(int width, int height, const char *filename) {
+    FILE *fp = fopen(filename, "w");
+    if (fp == NULL) {
+        fprintf(stderr, "Failed to open file: %s\n", filename);
+        exit(1);
+    }
+
+    CostStats::writeCSVHeader(fp);
+    for (const BenchmarkShape &shape : benchmarkShapes) {
+        setBenchmarkShape(shape.type);
+        collectCostStats(width, height);
+        costStats.writeCSV(fp, shape.name);
+        printf("%-10s edges/pixel %8.2f, curves/pixel %6.2f\n", shape.name,
+               costStats.numPixels > 0 ? costStats.totals[0] / costStats.numPixels : 0.0,
+               costStats.numPixels > 0 ? costStats.totals[1] / costStats.numPixels : 0.0);
+    }
+    fclose(fp);
+    printf("Cost statistics saved: %s\n", filename);
+}
+
 void update(GLFWwindow *window) {
+    CPU_PROFILE_SCOPE("update");
+
     static int frameCount = 260;  // 180, 260, 320
 
 #if SAVE_MOVIE
@@ -279,11 +1003,13 @@ void update(GLFWwindow *window) {
     camera.cameraPos.z = std::abs(7.0f * cos(frameCount * Pi / 360 - 0.5f * Pi));
     camera.viewMat = glm::lookAt(camera.cameraPos, camera.cameraDir, camera.cameraUp);
 
-    // Move light
-    if (bezLight.isMove) {
-        bezLight.translate.y = 1.5f * std::cos(Pi * frameCount / 120.0f);
-        bezLight.rotAngle.z = -frameCount * 0.5f;
-        bezLight.calcCPSworld();
+    // Move lights
+    for (auto &bezLight : bezLights.lights) {
+        if (bezLight.isMove) {
+            bezLight.translate.y = 1.5f * std::cos(Pi * frameCount / 120.0f);
+            bezLight.rotAngle.z = -frameCount * 0.5f;
+            bezLight.calcCPSworld();
+        }
     }
 
     if (isAnim) {
@@ -318,6 +1044,107 @@ void resize(GLFWwindow *window, int width, int height) {
 }
 
 int main(int argc, char **argv) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--no-shader-cache") == 0) {
+            setShaderCacheEnabled(false);
+        }
+
+        if (strcmp(argv[i], "--hot-reload") == 0) {
+            setShaderHotReload(true);
+        }
+
+        if (strcmp(argv[i], "--lights") == 0 && i + 1 < argc) {
+            numLights = std::max(1, std::min(atoi(argv[++i]), 8));
+        }
+
+        if (strcmp(argv[i], "--no-tiled-culling") == 0) {
+            isTiledCulling = false;
+        }
+
+        if (strcmp(argv[i], "--no-preclip") == 0) {
+            isPreclipped = false;
+        }
+
+        if (strcmp(argv[i], "--fixed-subdiv") == 0) {
+            isAdaptiveSubdiv = false;
+        }
+
+        if (strcmp(argv[i], "--no-light-lod") == 0) {
+            isLightLOD = false;
+        }
+
+        if (strcmp(argv[i], "--gauss") == 0 && i + 1 < argc) {
+            const int order = atoi(argv[++i]);
+            gaussOrder = order >= 16 ? 16 : order >= 8 ? 8 : 4;
+        }
+
+        if (strcmp(argv[i], "--no-polygon-fallback") == 0) {
+            isPolygonFallback = false;
+        }
+
+        if (strcmp(argv[i], "--bench") == 0) {
+            isBenchmark = true;
+        }
+
+        if (strcmp(argv[i], "--bench-clip") == 0) {
+            isClipBenchmark = true;
+        }
+
+        if (strcmp(argv[i], "--cost-csv") == 0 && i + 1 < argc) {
+            costCsvFilename = argv[++i];
+        }
+
+        if (strcmp(argv[i], "--cpu-profile") == 0 && i + 1 < argc) {
+            cpuProfileFilename = argv[++i];
+        }
+
+        if (strcmp(argv[i], "--frame-stats") == 0 && i + 1 < argc) {
+            frameStatsFilename = argv[++i];
+        }
+
+        if (strcmp(argv[i], "--clip") == 0 && i + 1 < argc) {
+            static const char *clipNames[] = { "algebraic", "bezier", "polygon", "newton" };
+            const char *name = argv[++i];
+            const auto it = std::find_if(std::begin(clipNames), std::end(clipNames),
+                                         [name](const char *clipName) { return strcmp(name, clipName) == 0; });
+            if (it == std::end(clipNames)) {
+                fprintf(stderr, "Unknown clipping method: %s\n", name);
+                return 1;
+            }
+            clipMethod = (ClipMethod) (it - std::begin(clipNames));
+        }
+
+        if (strcmp(argv[i], "--always-redraw") == 0) {
+            isRenderOnDemand = false;
+        }
+
+        if (strcmp(argv[i], "--deferred") == 0) {
+            isDeferred = true;
+        }
+
+        // reduced-resolution diffuse needs the G-buffer of the deferred path
+        if (strcmp(argv[i], "--lowres") == 0 && i + 1 < argc) {
+            lowResScale = atoi(argv[++i]) >= 4 ? 4 : 2;
+            isDeferred = true;
+        }
+
+        if (strcmp(argv[i], "--depth-prepass") == 0) {
+            isDepthPrepass = true;
+        }
+
+        if (strcmp(argv[i], "--lightmap") == 0) {
+            isLightmap = true;
+        }
+
+        if (strcmp(argv[i], "--dynres") == 0 && i + 1 < argc) {
+            renderBudgetMs = std::max(1.0, atof(argv[++i]));
+        }
+    }
+
+    // the main thread records first and gets the first track of the trace
+    setCpuProfileThreadName("main");
+    setCpuProfiling(cpuProfileFilename != nullptr);
+
     if (glfwInit() == GL_FALSE) {
         fprintf(stderr, "Initialization failed!\n");
         return 1;
@@ -352,6 +1179,9 @@ int main(int argc, char **argv) {
     }
     printf("Load OpenGL %d.%d\n", GLAD_VERSION_MAJOR(version), GLAD_VERSION_MINOR(version));
 
+    // Compile shader variants in the background
+    initShaderCompiler(window);
+
     // ImGui
     IMGUI_CHECKVERSION();
     ImGui::CreateContext();
@@ -365,15 +1195,60 @@ int main(int argc, char **argv) {
 
     // Other setups
     initializeGL();
+    sceneBuffer.initialize();
+    dynamicResolution.initialize();
+    costStats.initialize();
+    lightTimer.initialize();
+    guiTimer.initialize();
+    frameStats.initialize();
+    if (renderBudgetMs > 0.0) {
+        dynamicResolution.isEnabled = true;
+        dynamicResolution.budgetMs = renderBudgetMs;
+    }
+    setLightCount(numLights);
+    ltcFloor.isTiledCulling = isTiledCulling;
+    ltcFloor.isPreclipped = isPreclipped;
+    ltcFloor.isAdaptiveSubdiv = isAdaptiveSubdiv;
+    ltcFloor.isLightLOD = isLightLOD;
+    ltcFloor.gaussOrder = gaussOrder;
+    ltcFloor.isPolygonFallback = isPolygonFallback;
+    ltcFloor.clipMethod = clipMethod;
+    ltcFloor.isDeferred = isDeferred;
+    ltcFloor.lowResScale = lowResScale;
+    ltcFloor.isDepthPrepass = isDepthPrepass;
+    ltcFloor.isLightmap = isLightmap;
     glfwSetWindowSizeCallback(window, resize);
     glfwSetKeyCallback(window, keyboard);
 
+    if (isBenchmark || isClipBenchmark || costCsvFilename != nullptr) {
+        glfwSwapInterval(0);
+        update(window);
+
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        if (isBenchmark) {
+            runIntegratorBenchmark(viewport[2], viewport[3]);
+        }
+        if (isClipBenchmark) {
+            runClippingBenchmark(viewport[2], viewport[3]);
+        }
+        if (costCsvFilename != nullptr) {
+            runCostStatistics(viewport[2], viewport[3], costCsvFilename);
+        }
+        glfwSetWindowShouldClose(window, GL_TRUE);
+    }
+
     double totalTime = 0.0;
     uint32_t frameNum = 0;
     const uint32_t fpsUpdateSkip = 100;
+    bool isFirstFrame = true;
     while (glfwWindowShouldClose(window) == GL_FALSE) {
         const double startTime = glfwGetTime();
 
+        CPU_PROFILE_SCOPE("frame");
+
+        setGpuTimerFrame(frameStats.numFrames);
+        checkShaderFiles();
         update(window);
         draw();
 
@@ -387,16 +1262,53 @@ int main(int argc, char **argv) {
             frameNum = 0;
         }
 
-        glfwSwapBuffers(window);
+        {
+            CPU_PROFILE_SCOPE("swapBuffers");
+            glfwSwapBuffers(window);
+        }
         glfwPollEvents();
 
-        totalTime += (glfwGetTime() - startTime);
+        if (isFirstFrame) {
+            // GLFW timer starts at glfwInit()
+            glFinish();
+            printf("Time to first frame: %.1f ms (shader cache %s)\n", glfwGetTime() * 1000.0,
+                   isShaderCacheEnabled() ? "on" : "off");
+            isFirstFrame = false;
+        }
+
+        const double frameTime = glfwGetTime() - startTime;
+        totalTime += frameTime;
+        recordFrameTimes(frameTime * 1000.0);
+
+        // Sleep until the next input event while the scene is unchanged.
+        // Hot reload has to keep polling the shader files.
+        if (isRenderOnDemand && !isAnim && !isSceneDirty()) {
+            CPU_PROFILE_SCOPE("waitEvents");
+            if (isShaderHotReloadEnabled()) {
+                glfwWaitEventsTimeout(0.5);
+            } else {
+                glfwWaitEvents();
+            }
+        }
+    }
+
+    if (cpuProfileFilename != nullptr) {
+        saveCpuProfile(cpuProfileFilename);
+    }
+    if (frameStats.numFrames > 0) {
+        frameStats.printSummary();
+    }
+    if (frameStatsFilename != nullptr) {
+        frameStats.save(frameStatsFilename);
+    } else if (frameStats.numFrames > 0) {
+        saveFrameStats();
     }
 
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
     ImGui::DestroyContext();
 
+    terminateShaderCompiler();
     glfwDestroyWindow(window);
     glfwTerminate();
 
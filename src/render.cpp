@@ -7,6 +7,7 @@
 #include <stb_image.h>
 #include <tiny_obj_loader.h>
 
+#include "cpuProfiler.h"
 #include "render.h"
 
 Vertex::Vertex() :
@@ -31,107 +32,15 @@ void RenderObject::initialize() {
     specColor = glm::vec3(0.0f, 0.0f, 0.0f);
 }
 
-void RenderObject::buildShader(const std::string &basename) {
-    const std::string vertShaderFile = basename + ".vert";
-    const std::string fragShaderFile = basename + ".frag";
-
-    // Create shaders
-    GLuint vertShaderId = glCreateShader(GL_VERTEX_SHADER);
-    GLuint fragShaderId = glCreateShader(GL_FRAGMENT_SHADER);
-
-    // Load vertex shader source
-    std::ifstream vertFileInput(vertShaderFile.c_str(), std::ios::in);
-    if (!vertFileInput.is_open()) {
-        fprintf(stderr, "Failed to load vertex shader: %s\n", vertShaderFile.c_str());
-        exit(1);
-    }
-    std::istreambuf_iterator<char> vertDataBegin(vertFileInput);
-    std::istreambuf_iterator<char> vertDataEnd;
-    const std::string vertFileData(vertDataBegin, vertDataEnd);
-    const char *vertShaderCode = vertFileData.c_str();
-
-    // Load fragment shader source
-    std::ifstream fragFileInput(fragShaderFile.c_str(), std::ios::in);
-    if (!fragFileInput.is_open()) {
-        fprintf(stderr, "Failed to load fragment shader: %s\n", fragShaderFile.c_str());
-        exit(1);
-    }
-    std::istreambuf_iterator<char> fragDataBegin(fragFileInput);
-    std::istreambuf_iterator<char> fragDataEnd;
-    const std::string fragFileData(fragDataBegin, fragDataEnd);
-    const char *fragShaderCode = fragFileData.c_str();
-
-    // Compile
-    GLint compileStatus;
-    glShaderSource(vertShaderId, 1, &vertShaderCode, NULL);
-    glCompileShader(vertShaderId);
-    glGetShaderiv(vertShaderId, GL_COMPILE_STATUS, &compileStatus);
-    printf("Compiling %s...\n", vertShaderFile.c_str());
-    if (compileStatus == GL_FALSE) {
-        fprintf(stderr, "Failed to compile vertex shader!\n");
-
-        GLint logLength;
-        glGetShaderiv(vertShaderId, GL_INFO_LOG_LENGTH, &logLength);
-        if (logLength > 0) {
-            GLsizei length;
-            char *errmsg = new char[logLength + 1];
-            glGetShaderInfoLog(vertShaderId, logLength, &length, errmsg);
-
-            std::cerr << errmsg << std::endl;
-            fprintf(stderr, "%s", vertShaderCode);
-
-            delete[] errmsg;
-        }
-    }
-
-    glShaderSource(fragShaderId, 1, &fragShaderCode, NULL);
-    glCompileShader(fragShaderId);
-    glGetShaderiv(fragShaderId, GL_COMPILE_STATUS, &compileStatus);
-    printf("Compiling %s...\n", fragShaderFile.c_str());
-    if (compileStatus == GL_FALSE) {
-        fprintf(stderr, "Failed to compile fragment shader!\n");
-
-        GLint logLength;
-        glGetShaderiv(fragShaderId, GL_INFO_LOG_LENGTH, &logLength);
-        if (logLength > 0) {
-            GLsizei length;
-            char *errmsg = new char[logLength + 1];
-            glGetShaderInfoLog(fragShaderId, logLength, &length, errmsg);
-
-            std::cerr << errmsg << std::endl;
-            fprintf(stderr, "%s", vertShaderCode);
-
-            delete[] errmsg;
-        }
-    }
-
-    // Link to program
-    programId = glCreateProgram();
-    glAttachShader(programId, vertShaderId);
-    glAttachShader(programId, fragShaderId);
-
-    GLint linkState;
-    glLinkProgram(programId);
-    glGetProgramiv(programId, GL_LINK_STATUS, &linkState);
-    if (linkState == GL_FALSE) {
-        fprintf(stderr, "Failed to link shaders!\n");
-
-        GLint logLength;
-        glGetProgramiv(programId, GL_INFO_LOG_LENGTH, &logLength);
-        if (logLength > 0) {
-            GLsizei length;
-            char *errmsg = new char[logLength + 1];
-            glGetProgramInfoLog(programId, logLength, &length, errmsg);
-
-            std::cerr << errmsg << std::endl;
-            delete[] errmsg;
-        }
-
-        exit(1);
-    }
+void RenderObject::buildShader(const std::string &basename, const std::string &defines) {
+    CPU_PROFILE_SCOPE("buildShader", basename);
+    shaders.initialize(basename);
+    programId = shaders.get(defines);
 }
 
 void RenderObject::loadOBJ(const std::string &filename) {
+    CPU_PROFILE_SCOPE("loadOBJ", filename);
+
     // Load OBJ file.
     tinyobj::attrib_t attrib;
     std::vector<tinyobj::shape_t> shapes;
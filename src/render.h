@@ -12,6 +12,8 @@
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtx/transform.hpp>
 
+#include "shaderCompiler.h"
+
 struct Vertex {
     Vertex();
     Vertex(const glm::vec3 &pos, const glm::vec3 &norm, const glm::vec2 &uv);
@@ -31,11 +33,12 @@ struct Camera {
 
 struct RenderObject {
     void initialize();
-    void buildShader(const std::string &basename);
+    void buildShader(const std::string &basename, const std::string &defines = "");
     void loadOBJ(const std::string &filename);
     void loadTexture(const std::string &filename);
     void draw(const Camera &camera, const glm::vec3 &lightPos, const glm::vec3 &lightLe);
 
+    ShaderVariants shaders;
     GLuint programId;
     GLuint vaoId;
     GLuint vboId;
@@ -0,0 +1,62 @@
+#include <algorithm>
+#include <cmath>
+
+#include "rollingStats.h"
+
+void RollingStats::initialize(int capacity) {
+    samples.clear();
+    samples.reserve(capacity);
+    this->capacity = capacity;
+    next = 0;
+}
+
+void RollingStats::add(double value) {
+    if ((int) samples.size() < capacity) {
+        samples.push_back(value);
+    } else {
+        samples[next] = value;
+    }
+    next = (next + 1) % capacity;
+}
+
+double RollingStats::sample(int i) const {
+    const int oldest = (int) samples.size() < capacity ? 0 : next;
+    return samples[(oldest + i) % capacity];
+}
+
+double RollingStats::latest() const {
+    if (samples.empty()) {
+        return 0.0;
+    }
+    return samples[(next + capacity - 1) % capacity];
+}
+
+double RollingStats::mean() const {
+    if (samples.empty()) {
+        return 0.0;
+    }
+    double sum = 0.0;
+    for (double sample : samples) {
+        sum += sample;
+    }
+    return sum / samples.size();
+}
+
+double RollingStats::min() const {
+    return samples.empty() ? 0.0 : *std::min_element(samples.begin(), samples.end());
+}
+
+double RollingStats::max() const {
+    return samples.empty() ? 0.0 : *std::max_element(samples.begin(), samples.end());
+}
+
+double RollingStats::percentile(double p) const {
+    if (samples.empty()) {
+        return 0.0;
+    }
+    std::vector<double> sorted = samples;
+    const int rank = (int) std::ceil(p / 100.0 * sorted.size());
+    const int index = std::min(std::max(rank - 1, 0), (int) sorted.size() - 1);
+    std::nth_element(sorted.begin(), sorted.begin() + index, sorted.end());
+    return sorted[index];
+}
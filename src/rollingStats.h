@@ -0,0 +1,28 @@
+#pragma once
+
+#include <vector>
+
+// ----------------------------------------------------------------------------
+// Statistics over the latest samples of a measurement
+// Samples are kept in a fixed ring, so the average, extremes and percentiles
+// follow the recent frames and old spikes drop out.
+// ----------------------------------------------------------------------------
+
+static constexpr int ROLLING_STATS_SIZE = 120;
+
+struct RollingStats {
+    void initialize(int capacity = ROLLING_STATS_SIZE);
+    void add(double value);
+
+    int count() const { return (int) samples.size(); }
+    double sample(int i) const;  // i-th oldest
+    double latest() const;
+    double mean() const;
+    double min() const;
+    double max() const;
+    double percentile(double p) const;  // p in [0, 100], nearest rank
+
+    std::vector<double> samples;  // ring, oldest at next once full
+    int capacity;
+    int next;
+};
@@ -0,0 +1,63 @@
+#include <cstdio>
+#include <cstdlib>
+
+#include <glad/gl.h>
+
+#include "sceneBuffer.h"
+
+void SceneBuffer::initialize() {
+    width = 0;
+    height = 0;
+
+    fboId = 0;
+    colorTexId = 0;
+    depthStencilRboId = 0;
+}
+
+void SceneBuffer::resize(int width, int height) {
+    if (this->width == width && this->height == height) {
+        return;
+    }
+    this->width = width;
+    this->height = height;
+
+    if (fboId == 0) {
+        glGenFramebuffers(1, &fboId);
+        glGenTextures(1, &colorTexId);
+        glGenRenderbuffers(1, &depthStencilRboId);
+    }
+
+    GLint prevFboId;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &prevFboId);
+    glBindFramebuffer(GL_FRAMEBUFFER, fboId);
+
+    glBindTexture(GL_TEXTURE_2D, colorTexId);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTexId, 0);
+
+    // light shapes are drawn with stencil masks
+    glBindRenderbuffer(GL_RENDERBUFFER, depthStencilRboId);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthStencilRboId);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        fprintf(stderr, "Scene buffer is incomplete: %dx%d\n", width, height);
+        exit(1);
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, prevFboId);
+}
+
+void SceneBuffer::blitToScreen(int screenWidth, int screenHeight) const {
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, fboId);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    glBlitFramebuffer(0, 0, width, height, 0, 0, screenWidth, screenHeight, GL_COLOR_BUFFER_BIT,
+                      width == screenWidth && height == screenHeight ? GL_NEAREST : GL_LINEAR);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#define GLFW_INCLUDE_GLU
+#include <GLFW/glfw3.h>
+
+// ----------------------------------------------------------------------------
+// Offscreen target holding the last rendered scene (without GUI)
+// The scene is drawn here and copied to the window, so that an unchanged
+// frame can be presented again without running the LTC passes.
+// ----------------------------------------------------------------------------
+
+struct SceneBuffer {
+    void initialize();
+    void resize(int width, int height);
+    void blitToScreen(int screenWidth, int screenHeight) const;
+
+    int width;
+    int height;
+
+    GLuint fboId;
+    GLuint colorTexId;
+    GLuint depthStencilRboId;
+};
@@ -0,0 +1,163 @@
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <vector>
+
+#include <sys/stat.h>
+#if defined(_WIN32)
+#    include <direct.h>
+#endif
+
+#include <glad/gl.h>
+
+#include "constants.h"
+#include "shaderCache.h"
+
+namespace {
+
+bool isEnabled = true;
+
+const uint32_t CACHE_MAGIC = 0x43544c42;  // "BLTC"
+const uint32_t CACHE_VERSION = 1;
+
+struct CacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t binaryFormat;
+    uint32_t binaryLength;
+};
+
+// 64-bit FNV-1a
+uint64_t hashString(uint64_t hash, const std::string &str) {
+    for (unsigned char c : str) {
+        hash ^= c;
+        hash *= 0x100000001b3ull;
+    }
+    // separator so that ("ab", "c") and ("a", "bc") differ
+    hash ^= 0xff;
+    hash *= 0x100000001b3ull;
+    return hash;
+}
+
+std::string glString(GLenum name) {
+    const GLubyte *str = glGetString(name);
+    return str ? std::string((const char *) str) : std::string();
+}
+
+void makeCacheDir() {
+#if defined(_WIN32)
+    _mkdir(SHADER_CACHE_DIR.c_str());
+#else
+    mkdir(SHADER_CACHE_DIR.c_str(), 0755);
+#endif
+}
+
+std::string cacheFilename(const std::string &basename, const std::string &key) {
+    const size_t pos = basename.find_last_of("/\\");
+    const std::string stem = pos == std::string::npos ? basename : basename.substr(pos + 1);
+    return SHADER_CACHE_DIR + "/" + stem + "_" + key + ".bin";
+}
+
+bool supportsProgramBinary() {
+    GLint numFormats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numFormats);
+    return numFormats > 0;
+}
+
+}  // anonymous namespace
+
+void setShaderCacheEnabled(bool enabled) {
+    isEnabled = enabled;
+}
+
+bool isShaderCacheEnabled() {
+    return isEnabled;
+}
+
+std::string shaderCacheKey(const std::string &vertCode, const std::string &fragCode) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    hash = hashString(hash, vertCode);
+    hash = hashString(hash, fragCode);
+    hash = hashString(hash, glString(GL_VENDOR));
+    hash = hashString(hash, glString(GL_RENDERER));
+    hash = hashString(hash, glString(GL_VERSION));
+
+    char buf[32];
+    sprintf(buf, "%016llx", (unsigned long long) hash);
+    return std::string(buf);
+}
+
+bool loadProgramBinary(GLuint programId, const std::string &basename, const std::string &key) {
+    if (!isEnabled || !supportsProgramBinary()) {
+        return false;
+    }
+
+    const std::string filename = cacheFilename(basename, key);
+    std::ifstream reader(filename.c_str(), std::ios::in | std::ios::binary);
+    if (!reader.is_open()) {
+        return false;
+    }
+
+    CacheHeader header;
+    reader.read((char *) &header, sizeof(CacheHeader));
+    if (!reader || header.magic != CACHE_MAGIC || header.version != CACHE_VERSION || header.binaryLength == 0) {
+        fprintf(stderr, "Invalid program cache, rebuilding: %s\n", filename.c_str());
+        return false;
+    }
+
+    std::vector<char> binary(header.binaryLength);
+    reader.read(binary.data(), header.binaryLength);
+    if (!reader) {
+        fprintf(stderr, "Truncated program cache, rebuilding: %s\n", filename.c_str());
+        return false;
+    }
+
+    // The driver may still reject the binary (e.g., after a driver update that
+    // keeps the same version string). Link status tells whether it was accepted.
+    glProgramBinary(programId, header.binaryFormat, binary.data(), (GLsizei) binary.size());
+
+    GLint linkState;
+    glGetProgramiv(programId, GL_LINK_STATUS, &linkState);
+    if (linkState == GL_FALSE) {
+        fprintf(stderr, "Program cache rejected by driver, rebuilding: %s\n", filename.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+void saveProgramBinary(GLuint programId, const std::string &basename, const std::string &key) {
+    if (!isEnabled || !supportsProgramBinary()) {
+        return;
+    }
+
+    GLint binaryLength = 0;
+    glGetProgramiv(programId, GL_PROGRAM_BINARY_LENGTH, &binaryLength);
+    if (binaryLength <= 0) {
+        return;
+    }
+
+    std::vector<char> binary(binaryLength);
+    GLenum binaryFormat;
+    GLsizei length = 0;
+    glGetProgramBinary(programId, binaryLength, &length, &binaryFormat, binary.data());
+    if (length <= 0) {
+        return;
+    }
+
+    makeCacheDir();
+    const std::string filename = cacheFilename(basename, key);
+    std::ofstream writer(filename.c_str(), std::ios::out | std::ios::binary);
+    if (!writer.is_open()) {
+        fprintf(stderr, "Failed to write program cache: %s\n", filename.c_str());
+        return;
+    }
+
+    CacheHeader header;
+    header.magic = CACHE_MAGIC;
+    header.version = CACHE_VERSION;
+    header.binaryFormat = binaryFormat;
+    header.binaryLength = (uint32_t) length;
+    writer.write((const char *) &header, sizeof(CacheHeader));
+    writer.write(binary.data(), length);
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <string>
+
+#define GLFW_INCLUDE_GLU
+#include <GLFW/glfw3.h>
+
+// ----------------------------------------------------------------------------
+// On-disk cache of linked program binaries (glGetProgramBinary / glProgramBinary)
+// ----------------------------------------------------------------------------
+
+void setShaderCacheEnabled(bool enabled);
+bool isShaderCacheEnabled();
+
+// Key of a program built from the given sources on the current driver.
+// It combines the source hash with the GL vendor, renderer and version strings.
+std::string shaderCacheKey(const std::string &vertCode, const std::string &fragCode);
+
+// Try to restore a linked program from cache. Returns false when no valid
+// binary exists, in which case the program must be compiled from source.
+bool loadProgramBinary(GLuint programId, const std::string &basename, const std::string &key);
+void saveProgramBinary(GLuint programId, const std::string &basename, const std::string &key);
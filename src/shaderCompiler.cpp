@@ -0,0 +1,500 @@
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <sys/stat.h>
+#if defined(_WIN32)
+#    include <io.h>
+#else
+#    include <dirent.h>
+#endif
+
+#include <glad/gl.h>
+
+#include "constants.h"
+#include "cpuProfiler.h"
+#include "shaderCache.h"
+#include "shaderCompiler.h"
+
+#ifndef GL_COMPLETION_STATUS_KHR
+#    define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+namespace {
+
+typedef void(GLAD_API_PTR *PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)(GLuint count);
+
+bool isParallelCompile = false;
+
+// worker thread with a shared context, used without GL_KHR_parallel_shader_compile
+GLFWwindow *workerWindow = nullptr;
+std::thread workerThread;
+std::mutex jobMutex;
+std::condition_variable jobCond;
+std::deque<std::shared_ptr<ShaderJob>> jobQueue;
+bool isWorkerExit = false;
+
+// hot reload
+bool isHotReload = false;
+int generation = 0;
+double lastCheckTime = 0.0;
+std::map<std::string, time_t> watchedFiles;
+bool isDirectoryScanned = false;
+const double CHECK_INTERVAL = 0.5;
+
+time_t modifiedTime(const std::string &filename) {
+    struct stat st;
+    if (stat(filename.c_str(), &st) != 0) {
+        return 0;
+    }
+    return st.st_mtime;
+}
+
+bool isShaderFile(const std::string &name) {
+    const size_t dot = name.rfind('.');
+    return dot != std::string::npos && (name.compare(dot, 5, ".vert") == 0 || name.compare(dot, 5, ".frag") == 0);
+}
+
+// .vert and .frag files of a directory, as paths starting with it
+void listShaderFiles(const std::string &dirname, std::vector<std::string> &filenames) {
+#if defined(_WIN32)
+    struct _finddata_t entry;
+    const intptr_t handle = _findfirst((dirname + "/*").c_str(), &entry);
+    if (handle == -1) {
+        return;
+    }
+    do {
+        if (isShaderFile(entry.name)) {
+            filenames.push_back(dirname + "/" + entry.name);
+        }
+    } while (_findnext(handle, &entry) == 0);
+    _findclose(handle);
+#else
+    DIR *dir = opendir(dirname.c_str());
+    if (dir == NULL) {
+        return;
+    }
+    while (struct dirent *entry = readdir(dir)) {
+        if (isShaderFile(entry->d_name)) {
+            filenames.push_back(dirname + "/" + entry->d_name);
+        }
+    }
+    closedir(dir);
+#endif
+}
+
+// Insert permutation defines right after the "#version" line
+std::string injectDefines(const std::string &source, const std::string &defines) {
+    if (defines.empty()) {
+        return source;
+    }
+
+    const size_t eol = source.find('\n');
+    if (eol == std::string::npos) {
+        return source + "\n" + defines;
+    }
+    return source.substr(0, eol + 1) + defines + source.substr(eol + 1);
+}
+
+bool readShaderFile(const std::string &filename, const std::string &defines, std::string &code) {
+    std::ifstream reader(filename.c_str(), std::ios::in);
+    if (!reader.is_open()) {
+        fprintf(stderr, "Failed to load shader: %s\n", filename.c_str());
+        return false;
+    }
+    std::istreambuf_iterator<char> dataBegin(reader);
+    std::istreambuf_iterator<char> dataEnd;
+    code = injectDefines(std::string(dataBegin, dataEnd), defines);
+
+    if (watchedFiles.find(filename) == watchedFiles.end()) {
+        watchedFiles[filename] = modifiedTime(filename);
+    }
+    return true;
+}
+
+bool readShaderJob(ShaderJob &job) {
+    if (!readShaderFile(job.basename + ".vert", job.defines, job.vertCode) ||
+        !readShaderFile(job.basename + ".frag", job.defines, job.fragCode)) {
+        return false;
+    }
+    job.cacheKey = shaderCacheKey(job.vertCode, job.fragCode);
+    return true;
+}
+
+void printShaderLog(GLuint shaderId) {
+    GLint logLength;
+    glGetShaderiv(shaderId, GL_INFO_LOG_LENGTH, &logLength);
+    if (logLength > 0) {
+        GLsizei length;
+        char *errmsg = new char[logLength + 1];
+        glGetShaderInfoLog(shaderId, logLength, &length, errmsg);
+
+        std::cerr << errmsg << std::endl;
+        delete[] errmsg;
+    }
+}
+
+void printProgramLog(GLuint programId) {
+    GLint logLength;
+    glGetProgramiv(programId, GL_INFO_LOG_LENGTH, &logLength);
+    if (logLength > 0) {
+        GLsizei length;
+        char *errmsg = new char[logLength + 1];
+        glGetProgramInfoLog(programId, logLength, &length, errmsg);
+
+        std::cerr << errmsg << std::endl;
+        delete[] errmsg;
+    }
+}
+
+// Issue compile and link commands. With parallel compilation these return
+// immediately and the work is done by driver threads.
+void startCompile(ShaderJob &job) {
+    const char *vertShaderCode = job.vertCode.c_str();
+    const char *fragShaderCode = job.fragCode.c_str();
+
+    job.vertShaderId = glCreateShader(GL_VERTEX_SHADER);
+    glShaderSource(job.vertShaderId, 1, &vertShaderCode, NULL);
+    glCompileShader(job.vertShaderId);
+
+    job.fragShaderId = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(job.fragShaderId, 1, &fragShaderCode, NULL);
+    glCompileShader(job.fragShaderId);
+
+    glAttachShader(job.programId, job.vertShaderId);
+    glAttachShader(job.programId, job.fragShaderId);
+    glProgramParameteri(job.programId, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    glLinkProgram(job.programId);
+}
+
+// Check compile and link results (blocks until the driver finishes)
+bool finishCompile(ShaderJob &job) {
+    bool success = true;
+
+    GLint compileStatus;
+    glGetShaderiv(job.vertShaderId, GL_COMPILE_STATUS, &compileStatus);
+    if (compileStatus == GL_FALSE) {
+        fprintf(stderr, "Failed to compile vertex shader: %s.vert\n", job.basename.c_str());
+        printShaderLog(job.vertShaderId);
+        success = false;
+    }
+
+    glGetShaderiv(job.fragShaderId, GL_COMPILE_STATUS, &compileStatus);
+    if (compileStatus == GL_FALSE) {
+        fprintf(stderr, "Failed to compile fragment shader: %s.frag\n", job.basename.c_str());
+        printShaderLog(job.fragShaderId);
+        success = false;
+    }
+
+    GLint linkState;
+    glGetProgramiv(job.programId, GL_LINK_STATUS, &linkState);
+    if (linkState == GL_FALSE && success) {
+        fprintf(stderr, "Failed to link shaders: %s\n", job.basename.c_str());
+        printProgramLog(job.programId);
+        success = false;
+    }
+
+    glDetachShader(job.programId, job.vertShaderId);
+    glDetachShader(job.programId, job.fragShaderId);
+    glDeleteShader(job.vertShaderId);
+    glDeleteShader(job.fragShaderId);
+
+    if (success) {
+        saveProgramBinary(job.programId, job.basename, job.cacheKey);
+    }
+    return success;
+}
+
+// Compile on the current thread and context
+int compileNow(ShaderJob &job) {
+    CPU_PROFILE_SCOPE("compileProgram", job.basename + job.defines);
+
+    job.programId = glCreateProgram();
+    if (loadProgramBinary(job.programId, job.basename, job.cacheKey)) {
+        return SHADER_JOB_READY;
+    }
+
+    startCompile(job);
+    return finishCompile(job) ? SHADER_JOB_READY : SHADER_JOB_FAILED;
+}
+
+void workerLoop() {
+    glfwMakeContextCurrent(workerWindow);
+    setCpuProfileThreadName("shader compiler");
+
+    while (true) {
+        std::shared_ptr<ShaderJob> job;
+        {
+            std::unique_lock<std::mutex> lock(jobMutex);
+            jobCond.wait(lock, [] { return isWorkerExit || !jobQueue.empty(); });
+            if (isWorkerExit) {
+                break;
+            }
+            job = jobQueue.front();
+            jobQueue.pop_front();
+        }
+
+        const int state = compileNow(*job);
+
+        // make the linked program visible to the main context before publishing it
+        glFinish();
+        job->state = state;
+    }
+
+    glfwMakeContextCurrent(nullptr);
+}
+
+}  // anonymous namespace
+
+void initShaderCompiler(GLFWwindow *window) {
+    GLADapiproc maxThreads = nullptr;
+    if (glfwExtensionSupported("GL_KHR_parallel_shader_compile")) {
+        maxThreads = (GLADapiproc) glfwGetProcAddress("glMaxShaderCompilerThreadsKHR");
+    } else if (glfwExtensionSupported("GL_ARB_parallel_shader_compile")) {
+        maxThreads = (GLADapiproc) glfwGetProcAddress("glMaxShaderCompilerThreadsARB");
+    }
+
+    if (maxThreads != nullptr) {
+        // let the driver choose the number of compiler threads
+        ((PFNGLMAXSHADERCOMPILERTHREADSKHRPROC) maxThreads)(0xffffffff);
+        isParallelCompile = true;
+        printf("Shader compiler: parallel shader compile extension\n");
+        return;
+    }
+
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    workerWindow = glfwCreateWindow(1, 1, "", NULL, window);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+    glfwMakeContextCurrent(window);
+
+    if (workerWindow == NULL) {
+        printf("Shader compiler: synchronous (shared context unavailable)\n");
+        return;
+    }
+
+    isWorkerExit = false;
+    workerThread = std::thread(workerLoop);
+    printf("Shader compiler: worker thread\n");
+}
+
+void terminateShaderCompiler() {
+    if (workerWindow == nullptr) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(jobMutex);
+        isWorkerExit = true;
+        jobQueue.clear();
+    }
+    jobCond.notify_all();
+    workerThread.join();
+
+    glfwDestroyWindow(workerWindow);
+    workerWindow = nullptr;
+}
+
+std::shared_ptr<ShaderJob> compileProgramAsync(const std::string &basename, const std::string &defines) {
+    CPU_PROFILE_SCOPE("compileProgramAsync", basename + defines);
+
+    auto job = std::make_shared<ShaderJob>();
+    job->basename = basename;
+    job->defines = defines;
+    job->programId = 0;
+    job->vertShaderId = 0;
+    job->fragShaderId = 0;
+    job->startTime = glfwGetTime();
+    job->state = SHADER_JOB_PENDING;
+
+    // sources are read on the main thread, which also owns the file watcher
+    if (!readShaderJob(*job)) {
+        job->state = SHADER_JOB_FAILED;
+        return job;
+    }
+
+    if (workerWindow != nullptr) {
+        {
+            std::lock_guard<std::mutex> lock(jobMutex);
+            jobQueue.push_back(job);
+        }
+        jobCond.notify_one();
+        return job;
+    }
+
+    job->programId = glCreateProgram();
+    if (loadProgramBinary(job->programId, job->basename, job->cacheKey)) {
+        job->state = SHADER_JOB_READY;
+        return job;
+    }
+
+    startCompile(*job);
+    if (!isParallelCompile) {
+        job->state = finishCompile(*job) ? SHADER_JOB_READY : SHADER_JOB_FAILED;
+    }
+    return job;
+}
+
+int pollShaderJob(ShaderJob &job) {
+    if (job.state == SHADER_JOB_PENDING && isParallelCompile) {
+        GLint isCompleted = GL_FALSE;
+        glGetProgramiv(job.programId, GL_COMPLETION_STATUS_KHR, &isCompleted);
+        if (isCompleted == GL_TRUE) {
+            job.state = finishCompile(job) ? SHADER_JOB_READY : SHADER_JOB_FAILED;
+        }
+    }
+    return job.state;
+}
+
+int waitShaderJob(ShaderJob &job) {
+    if (job.state == SHADER_JOB_PENDING && isParallelCompile) {
+        job.state = finishCompile(job) ? SHADER_JOB_READY : SHADER_JOB_FAILED;
+    }
+    while (job.state == SHADER_JOB_PENDING) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return job.state;
+}
+
+void setShaderHotReload(bool enabled) {
+    isHotReload = enabled;
+}
+
+bool isShaderHotReloadEnabled() {
+    return isHotReload;
+}
+
+void checkShaderFiles() {
+    if (!isHotReload) {
+        return;
+    }
+
+    const double now = glfwGetTime();
+    if (now - lastCheckTime < CHECK_INTERVAL) {
+        return;
+    }
+    lastCheckTime = now;
+
+    // The whole shader directory is watched, not only the files read so far,
+    // so that a file added while running also starts a new generation
+    bool isModified = false;
+    std::vector<std::string> filenames;
+    listShaderFiles(SHADER_DIR, filenames);
+    for (const std::string &filename : filenames) {
+        if (watchedFiles.find(filename) == watchedFiles.end()) {
+            if (isDirectoryScanned) {
+                printf("Shader added: %s\n", filename.c_str());
+                isModified = true;
+            }
+            watchedFiles[filename] = modifiedTime(filename);
+        }
+    }
+    isDirectoryScanned = true;
+
+    for (auto &it : watchedFiles) {
+        const time_t mtime = modifiedTime(it.first);
+        if (mtime != it.second) {
+            printf("Shader modified: %s\n", it.first.c_str());
+            it.second = mtime;
+            isModified = true;
+        }
+    }
+
+    if (isModified) {
+        generation++;
+    }
+}
+
+int shaderGeneration() {
+    return generation;
+}
+
+ShaderVariant::ShaderVariant() :
+    programId(0), generation(-1), job() {
+}
+
+void ShaderVariants::initialize(const std::string &basename) {
+    // programs of a previous initialization are owned here, release them
+    for (auto &it : variants) {
+        ShaderVariant &variant = it.second;
+        if (variant.job) {
+            // the worker may still be compiling into the program of the job
+            waitShaderJob(*variant.job);
+            if (variant.job->programId != 0) {
+                glDeleteProgram(variant.job->programId);
+            }
+            variant.job.reset();
+        }
+        if (variant.programId != 0) {
+            glDeleteProgram(variant.programId);
+        }
+    }
+
+    this->basename = basename;
+    variants.clear();
+}
+
+void ShaderVariants::update(const std::string &defines, ShaderVariant &variant) {
+    // (re)build when the variant is new or its sources have been modified
+    if (!variant.job && variant.generation != shaderGeneration()) {
+        variant.job = compileProgramAsync(basename, defines);
+        variant.generation = shaderGeneration();
+    }
+
+    if (variant.job) {
+        const int state = pollShaderJob(*variant.job);
+        if (state == SHADER_JOB_READY) {
+            if (variant.programId != 0) {
+                glDeleteProgram(variant.programId);
+            }
+            variant.programId = variant.job->programId;
+            printf("Built program %s (%.1f ms)\n", basename.c_str(),
+                   (glfwGetTime() - variant.job->startTime) * 1000.0);
+            variant.job.reset();
+        } else if (state == SHADER_JOB_FAILED) {
+            // keep using the previous program, if any
+            if (variant.job->programId != 0) {
+                glDeleteProgram(variant.job->programId);
+            }
+            variant.job.reset();
+        }
+    }
+}
+
+bool ShaderVariants::isPending() const {
+    for (const auto &it : variants) {
+        if (it.second.job) {
+            return true;
+        }
+    }
+    return false;
+}
+
+GLuint ShaderVariants::get(const std::string &defines) {
+    ShaderVariant &variant = variants[defines];
+    update(defines, variant);
+    if (variant.programId != 0) {
+        return variant.programId;
+    }
+
+    // While the specialized variant compiles, draw with the generic program,
+    // which reads every feature from runtime uniforms.
+    ShaderVariant &generic = variants[""];
+    update("", generic);
+    if (generic.programId == 0) {
+        // nothing to draw with yet (e.g., the first frame)
+        if (generic.job && waitShaderJob(*generic.job) == SHADER_JOB_READY) {
+            update("", generic);
+        }
+
+        if (generic.programId == 0) {
+            fprintf(stderr, "Failed to build shader: %s\n", basename.c_str());
+            exit(1);
+        }
+    }
+    return generic.programId;
+}
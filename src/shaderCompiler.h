@@ -0,0 +1,72 @@
+#pragma once
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <string>
+
+#define GLFW_INCLUDE_GLU
+#include <GLFW/glfw3.h>
+
+// ----------------------------------------------------------------------------
+// Shader compilation
+// Programs are compiled with GL_KHR_parallel_shader_compile when available,
+// otherwise on a worker thread that owns a context shared with the main window.
+// ----------------------------------------------------------------------------
+
+enum ShaderJobState {
+    SHADER_JOB_PENDING = 0,
+    SHADER_JOB_READY = 1,
+    SHADER_JOB_FAILED = 2,
+};
+
+struct ShaderJob {
+    std::string basename;
+    std::string defines;
+    std::string vertCode;
+    std::string fragCode;
+    std::string cacheKey;
+    GLuint programId;
+    GLuint vertShaderId;
+    GLuint fragShaderId;
+    double startTime;
+    std::atomic<int> state;
+};
+
+void initShaderCompiler(GLFWwindow *window);
+void terminateShaderCompiler();
+
+// Start building a program in the background, poll until it is not pending
+std::shared_ptr<ShaderJob> compileProgramAsync(const std::string &basename, const std::string &defines);
+int pollShaderJob(ShaderJob &job);
+int waitShaderJob(ShaderJob &job);
+
+// Hot reload watches every shader file in SHADER_DIR and every file read so
+// far, and bumps the generation number when one is modified or added.
+void setShaderHotReload(bool enabled);
+bool isShaderHotReloadEnabled();
+void checkShaderFiles();
+int shaderGeneration();
+
+// ----------------------------------------------------------------------------
+// Permutations of one shader, each compiled lazily in the background. The
+// previously linked program keeps being used until its replacement is ready.
+// ----------------------------------------------------------------------------
+
+struct ShaderVariant {
+    ShaderVariant();
+
+    GLuint programId;
+    int generation;
+    std::shared_ptr<ShaderJob> job;
+};
+
+struct ShaderVariants {
+    void initialize(const std::string &basename);
+    void update(const std::string &defines, ShaderVariant &variant);
+    GLuint get(const std::string &defines);
+    bool isPending() const;
+
+    std::string basename;
+    std::map<std::string, ShaderVariant> variants;
+};